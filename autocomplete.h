@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Prefix completion over a growing set of keys, each owned by an item with a score that only
+         * grows (likes).
+         *
+         * Keys live in a radix trie whose nodes sit in one vector and link by index; edge labels are
+         * slices of a shared arena holding all keys. Every node stores the topK best-scored items below it,
+         * so a completion walks the prefix and copies one list: the cost depends on the prefix, not on the
+         * number of keys. Inserting a key or raising a score touches only the nodes on the key's path.
+         * Keys are matched case-insensitively for ASCII.
+         */
+        class CompletionIndex {
+        public:
+            static constexpr size_t topK = 8;
+
+            struct Completion {
+                uint32_t item;
+                uint32_t score;
+            };
+
+        private:
+            static constexpr uint32_t none = UINT32_MAX;
+
+            struct Node {
+                uint32_t labelOffset = 0;
+                uint32_t labelLength = 0;
+                uint32_t firstChild = none;
+                uint32_t nextSibling = none;
+                uint32_t topCount = 0;
+                std::array<Completion, topK> top;
+            };
+
+            struct Key {
+                uint32_t offset;
+                uint32_t length;
+            };
+
+            std::vector<Node> nodes{1};
+            std::string arena;
+            std::vector<Key> keys;
+            std::vector<uint32_t> scores;
+
+            static char fold(const char c) {
+                return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+
+            static bool ranksBefore(const Completion &left, const Completion &right) {
+                return left.score != right.score ? left.score > right.score : left.item < right.item;
+            }
+
+            uint32_t findChild(const uint32_t node, const char first) const {
+                for (uint32_t child = nodes[node].firstChild; child != none; child = nodes[child].nextSibling)
+                    if (arena[nodes[child].labelOffset] == first)
+                        return child;
+                return none;
+            }
+
+            /**
+             * Puts the item into the node's list with its current score, if it ranks high enough.
+             */
+            void promote(Node &node, const uint32_t item) {
+                const Completion completion{item, scores[item]};
+                uint32_t position = 0;
+                while (position < node.topCount && node.top[position].item != item)
+                    ++position;
+                if (position == node.topCount) {
+                    if (node.topCount < topK)
+                        ++node.topCount;
+                    else if (!ranksBefore(completion, node.top[topK - 1]))
+                        return;
+                    position = node.topCount - 1;
+                }
+                while (position > 0 && ranksBefore(completion, node.top[position - 1])) {
+                    node.top[position] = node.top[position - 1];
+                    --position;
+                }
+                node.top[position] = completion;
+            }
+
+            uint32_t addNode(const uint32_t labelOffset, const uint32_t labelLength) {
+                nodes.emplace_back();
+                nodes.back().labelOffset = labelOffset;
+                nodes.back().labelLength = labelLength;
+                return static_cast<uint32_t>(nodes.size() - 1);
+            }
+
+        public:
+            /**
+             * @param item dense identifier of the key's owner, starting with score 0
+             */
+            void insert(const uint32_t item, const std::string_view key) {
+                if (item >= keys.size()) {
+                    keys.resize(item + 1, Key{0, 0});
+                    scores.resize(item + 1, 0);
+                }
+                const auto offset = static_cast<uint32_t>(arena.size());
+                for (const char c : key)
+                    arena.push_back(fold(c));
+                keys[item] = Key{offset, static_cast<uint32_t>(key.size())};
+
+                uint32_t node = 0;
+                uint32_t position = 0;
+                promote(nodes[node], item);
+                while (position < key.size()) {
+                    const uint32_t child = findChild(node, arena[offset + position]);
+                    if (child == none) {
+                        const uint32_t leaf = addNode(offset + position, static_cast<uint32_t>(key.size()) - position);
+                        nodes[leaf].nextSibling = nodes[node].firstChild;
+                        nodes[node].firstChild = leaf;
+                        promote(nodes[leaf], item);
+                        return;
+                    }
+
+                    uint32_t common = 0;
+                    const uint32_t labelLength = nodes[child].labelLength;
+                    while (common < labelLength && position + common < key.size() &&
+                           arena[nodes[child].labelOffset + common] == arena[offset + position + common])
+                        ++common;
+                    if (common < labelLength) {
+                        // the child keeps the common part and its place among siblings, the rest moves below
+                        const uint32_t tail = addNode(nodes[child].labelOffset + common, labelLength - common);
+                        Node &split = nodes[child];
+                        nodes[tail].firstChild = split.firstChild;
+                        nodes[tail].topCount = split.topCount;
+                        nodes[tail].top = split.top;
+                        split.labelLength = common;
+                        split.firstChild = tail;
+                    }
+                    promote(nodes[child], item);
+                    node = child;
+                    position += common;
+                }
+            }
+
+            /**
+             * Raises the item's score and reranks it on its key's path.
+             */
+            void addScore(const uint32_t item, const uint32_t delta = 1) {
+                scores[item] += delta;
+                const Key key = keys[item];
+                uint32_t node = 0;
+                uint32_t position = 0;
+                promote(nodes[node], item);
+                while (position < key.length) {
+                    node = findChild(node, arena[key.offset + position]);
+                    position += nodes[node].labelLength;
+                    promote(nodes[node], item);
+                }
+            }
+
+            /**
+             * @return up to min(count, topK) items whose key starts with the prefix, best scored first
+             */
+            std::vector<Completion> complete(const std::string_view prefix, const size_t count) const {
+                uint32_t node = 0;
+                size_t position = 0;
+                while (position < prefix.size()) {
+                    node = findChild(node, fold(prefix[position]));
+                    if (node == none)
+                        return {};
+                    const Node &current = nodes[node];
+                    for (uint32_t i = 0; i < current.labelLength && position < prefix.size(); ++i, ++position)
+                        if (arena[current.labelOffset + i] != fold(prefix[position]))
+                            return {};
+                }
+                const Node &found = nodes[node];
+                return std::vector<Completion>(found.top.begin(),
+                                               found.top.begin() + std::min<size_t>(count, found.topCount));
+            }
+
+            size_t memoryUsage() const {
+                return nodes.capacity() * sizeof(Node) + arena.capacity() + keys.capacity() * sizeof(Key) +
+                       scores.capacity() * sizeof(uint32_t);
+            }
+        };
+    }
+}
@@ -1,12 +1,32 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include "autocomplete.h"
+#include "blob-store.h"
+#include "catalog.h"
 #include "common-data.h"
+#include "inbox.h"
+#include "instrumentation.h"
+#include "password.h"
+#include "replication.h"
+#include "session.h"
+#include "social-graph.h"
+#include "trending.h"
 #include "util.h"
 
 namespace youtube {
@@ -47,223 +67,353 @@ namespace youtube {
                     : runtime_error("Exception: wrong password") {}
         };
 
+        class ServiceOverloadedException : public std::runtime_error {
+        public:
+            ServiceOverloadedException()
+                    : runtime_error("Exception: service overloaded, try again later") {}
+        };
 
-        class User : public std::enable_shared_from_this<User> {
+
+        class User {
         private:
-            const std::string password;
-            std::unordered_set<std::shared_ptr<User>> followers;
-            std::unordered_set<std::shared_ptr<User>> subscriptions;
-            std::vector<std::shared_ptr<Notification>> pendingNotifications;
-            std::vector<std::shared_ptr<Video>> videos;
+            const PasswordHash password;
+            NotificationInbox inbox;
 
         public:
+            const uint32_t id;
             const std::string name;
 
-            explicit User(std::string name, std::string password)
-                    : name(std::move(name)), password(std::move(password)) {}
-
-            const bool checkPassword(const std::string &pass) const {
-                return pass == password;
-            }
-
-            void addVideo(const std::shared_ptr<Video> video) {
-                videos.push_back(video);
-            }
+            explicit User(const uint32_t id, std::string name, PasswordHash password,
+                          const InboxSettings inboxSettings = InboxSettings())
+                    : id(id), name(std::move(name)), password(password), inbox(inboxSettings) {}
 
-            void addSubscription(const std::shared_ptr<User> subscription) {
-                subscriptions.insert(subscription);
-                subscription->followers.insert(shared_from_this());
+            const PasswordHash &getPasswordHash() const {
+                return password;
             }
 
-            void deferNotification(const std::shared_ptr<Notification> notification) {
-                pendingNotifications.push_back(notification);
+            void deferNotification(const uint32_t creatorId, const uint64_t videoKey, const uint64_t sequence) {
+                inbox.push(creatorId, videoKey, sequence);
             }
 
             void releasePendingNotifications() {
-                pendingNotifications.clear();
+                inbox.clear();
             }
 
-            const std::vector<std::shared_ptr<Notification>> &getPendingNotifications() {
-                return pendingNotifications;
+            NotificationInbox &getPendingNotifications() {
+                return inbox;
             }
 
-            const std::unordered_set<std::shared_ptr<User>> &getFollowers() const {
-                return followers;
+            const NotificationInbox &getPendingNotifications() const {
+                return inbox;
             }
         };
 
-        class BackendLikeable : public Likeable {
+        /**
+         * All users, videos and subscriptions of one node. The process-wide instance() is the primary;
+         * replicas own further instances kept in sync by apply(). When a replication log is attached,
+         * every mutation made through the methods below is appended to it in lock order.
+         */
+        class DataStorage {
         private:
-            std::unordered_set<std::string> whoLiked;
+            VideoCatalog catalog;
+            BlobStore blobs;
+            std::map<std::string, std::shared_ptr<User>> users;
+            std::vector<std::shared_ptr<User>> usersById;
+            SocialGraph socialGraph;
+            InboxSettings inboxSettings;
+            uint64_t notificationSequence = 0;
+            std::shared_ptr<ReplicationLog> replicationLog;
+            TrendingIndex trending;
+            CompletionIndex videoCompletions;
+            CompletionIndex userCompletions;
+            mutable std::shared_mutex mutex;
 
         public:
-            void like(const std::string &userName) {
-                whoLiked.insert(userName);
-            }
+            DataStorage() = default;
+
+            DataStorage(const DataStorage &) = delete;
+
+            DataStorage(DataStorage &&) = delete;
 
-            const size_t getLikes() const override {
-                return whoLiked.size();
+            static DataStorage &instance() {
+                static DataStorage &storage = [] () -> DataStorage & {
+                    static DataStorage primary;
+                    MetricsRegistry::instance().addGaugeSource("storage", [] {
+                        const auto lock = primary.readLock();
+                        return primary.gauges();
+                    });
+                    return primary;
+                }();
+                return storage;
             }
-        };
 
-        class BackendComment : public Comment, public BackendLikeable {
-        public:
-            BackendComment(std::string userName, std::string content)
-                    : Comment(std::move(userName), std::move(content)) {}
+            /**
+             * Readers of the storage hold the shared lock, mutations hold the exclusive one.
+             */
+            std::shared_lock<std::shared_mutex> readLock() const {
+                return std::shared_lock<std::shared_mutex>(mutex);
+            }
 
-            const size_t getLikes() const override {
-                return BackendLikeable::getLikes();
+            std::unique_lock<std::shared_mutex> writeLock() {
+                return std::unique_lock<std::shared_mutex>(mutex);
             }
 
-            void addReply(const std::shared_ptr<Comment> reply) {
-                replies.push_back(reply);
+            std::shared_ptr<User> findUser(const std::string &name) const {
+                const auto found = users.find(name);
+                if (found == users.end())
+                    return nullptr;
+                return found->second;
             }
-        };
 
-        class BackendVideo : public Video, public BackendLikeable {
-        public:
-            BackendVideo(const std::string &id, const std::string &title) : Video(id, title) {}
+            std::shared_ptr<User> findUser(const uint32_t id) const {
+                if (id >= usersById.size())
+                    return nullptr;
+                return usersById[id];
+            }
 
-            void addComment(const std::shared_ptr<Comment> &comment) {
-                comments.push_back(comment);
+            /**
+             * Mutations are logged from here on; attach before the storage holds any data.
+             */
+            void setReplicationLog(std::shared_ptr<ReplicationLog> log) {
+                replicationLog = std::move(log);
             }
 
-            const size_t getLikes() const override {
-                return BackendLikeable::getLikes();
+            std::shared_ptr<User> createUser(const std::string &name, const PasswordHash &password) {
+                const std::shared_ptr<User> user =
+                        std::make_shared<User>(static_cast<uint32_t>(usersById.size()), name, password, inboxSettings);
+                usersById.push_back(user);
+                userCompletions.insert(user->id, name);
+                if (replicationLog)
+                    replicationLog->append(Mutation::createUser(name, password));
+                return users[name] = user;
             }
-        };
 
+            /**
+             * @return index of the video in the catalog
+             */
+            uint32_t createVideo(const std::shared_ptr<User> owner, const std::string &title,
+                                 const std::string &content) {
+                uint64_t key;
+                do {
+                    key = RandomSequenceGenerator::instance().nextUInt64();
+                } while (catalog.find(key) != VideoCatalog::none);
+                return createVideo(key, owner, title, content);
+            }
 
-        template<class T>
-        class SearchEngine {
-        private:
-            mutable std::function<const std::vector<std::shared_ptr<T>>(void)> supplier;
+            uint32_t createVideo(const uint64_t key, const std::shared_ptr<User> owner, const std::string &title,
+                                 const std::string &content) {
+                const uint32_t video = catalog.add(key, owner->id, title, blobs.put(content));
+                videoCompletions.insert(video, title);
+                trending.record(key);
+                if (replicationLog)
+                    replicationLog->append(Mutation::createVideo(key, owner->id, title, content));
+                return video;
+            }
 
-            template<class T1>
-            const std::remove_cv_t<decltype(std::declval<T1>().name)>
-            elementInfo(const std::shared_ptr<T1> element) const {
-                return element->name;
+            void addComment(const uint32_t video, const std::string &userName, const std::string &text) {
+                catalog.activity(video).addComment(std::make_shared<Comment>(userName, text));
+                if (replicationLog)
+                    replicationLog->append(Mutation::comment(catalog.key(video), userName, text));
             }
 
-            template<class T1>
-            const std::remove_cv_t<decltype(std::declval<T1>().title)>
-            elementInfo(const std::shared_ptr<T1> element) const {
-                return element->title;
+            /**
+             * The caller checks that the comment exists, as for likeComment().
+             */
+            void addReply(const uint32_t video, const size_t index, const std::string &userName,
+                          const std::string &text) {
+                catalog.activity(video).addReply(index, std::make_shared<Comment>(userName, text));
+                if (replicationLog)
+                    replicationLog->append(Mutation::reply(catalog.key(video), index, userName, text));
             }
 
-        public:
-            explicit SearchEngine(const std::function<const std::vector<std::shared_ptr<T>>()> &supplier)
-                    : supplier(supplier) {}
-
-            const std::vector<std::shared_ptr<T>> search(const std::vector<std::string> &request) const {
-                const std::vector<std::shared_ptr<T>> data = supplier();
-                std::vector<std::shared_ptr<T>> result;
-                for (const auto element : data) {
-                    const auto info = elementInfo(element);
-                    for (const auto &req : request) {
-                        const size_t foundBegin = info.find(req);
-                        const size_t foundEnd = foundBegin + req.size();
-                        if (foundBegin == std::string::npos)
-                            continue;
-                        if (foundBegin != 0 && info[foundBegin - 1] != ' ')
-                            continue;
-                        if (foundEnd != info.size() && info[foundEnd] != ' ')
-                            continue;
-
-                        result.push_back(element);
-                        break;
-                    }
+            void likeVideo(const uint32_t video, const std::string &userName) {
+                if (catalog.like(video, userName)) {
+                    trending.record(catalog.key(video));
+                    videoCompletions.addScore(video);
+                    userCompletions.addScore(catalog.owner(video));
                 }
-                return result;
+                if (replicationLog)
+                    replicationLog->append(Mutation::likeVideo(catalog.key(video), userName));
             }
-        };
 
-        class DataStorage {
-        private:
-            std::vector<std::shared_ptr<Video>> videos;
-            std::map<std::string, std::shared_ptr<Video>> idVideoMap;
-            std::map<std::string, std::string> videoContent;
-            std::map<std::string, std::shared_ptr<User>> users;
-            std::map<std::string, std::shared_ptr<User>> authTokens;
+            void likeComment(const uint32_t video, const size_t index, const std::string &userName) {
+                catalog.activity(video).likeComment(index, userName);
+                if (replicationLog)
+                    replicationLog->append(Mutation::likeComment(catalog.key(video), index, userName));
+            }
 
-            DataStorage() = default;
+            void subscribe(const uint32_t followerId, const uint32_t creatorId) {
+                socialGraph.subscribe(followerId, creatorId);
+                if (replicationLog)
+                    replicationLog->append(Mutation::subscribe(followerId, creatorId));
+            }
 
-        public:
-            DataStorage(const DataStorage &) = delete;
+            void unsubscribe(const uint32_t followerId, const uint32_t creatorId) {
+                socialGraph.unsubscribe(followerId, creatorId);
+                if (replicationLog)
+                    replicationLog->append(Mutation::unsubscribe(followerId, creatorId));
+            }
 
-            DataStorage(DataStorage &&) = delete;
+            /**
+             * Replays a mutation logged by the primary; the caller holds the write lock.
+             */
+            void apply(const Mutation &mutation) {
+                switch (mutation.kind) {
+                    case Mutation::Kind::CreateUser:
+                        createUser(mutation.name, mutation.password);
+                        break;
+                    case Mutation::Kind::CreateVideo:
+                        createVideo(mutation.videoKey, findUser(mutation.userId), mutation.text, *mutation.content);
+                        break;
+                    case Mutation::Kind::Comment:
+                        addComment(catalog.find(mutation.videoKey), mutation.name, mutation.text);
+                        break;
+                    case Mutation::Kind::Reply:
+                        addReply(catalog.find(mutation.videoKey), mutation.index, mutation.name, mutation.text);
+                        break;
+                    case Mutation::Kind::LikeVideo:
+                        likeVideo(catalog.find(mutation.videoKey), mutation.name);
+                        break;
+                    case Mutation::Kind::LikeComment:
+                        likeComment(catalog.find(mutation.videoKey), mutation.index, mutation.name);
+                        break;
+                    case Mutation::Kind::Subscribe:
+                        subscribe(mutation.userId, mutation.targetId);
+                        break;
+                    case Mutation::Kind::Unsubscribe:
+                        unsubscribe(mutation.userId, mutation.targetId);
+                        break;
+                }
+            }
 
-            static DataStorage &instance() {
-                static DataStorage storage;
-                return storage;
+            TrendingIndex &getTrending() {
+                return trending;
             }
 
-            std::shared_ptr<User> findUser(const std::string &name) {
-                if (users.find(name) == users.end())
-                    return nullptr;
-                return users[name];
+            /**
+             * Videos whose title and users whose name start with the prefix, most liked first.
+             */
+            Completions complete(const std::string_view prefix, const size_t count) const {
+                Completions result;
+                for (const CompletionIndex::Completion &completion : videoCompletions.complete(prefix, count))
+                    result.videos.push_back(catalog.view(completion.item));
+                for (const CompletionIndex::Completion &completion : userCompletions.complete(prefix, count))
+                    result.userNames.push_back(usersById[completion.item]->name);
+                return result;
             }
 
-            std::shared_ptr<User> createUser(const std::string &name, const std::string &password) {
-                return users[name] = std::make_shared<User>(name, password);
+            const SocialGraph &getSocialGraph() const {
+                return socialGraph;
             }
 
-            std::shared_ptr<Video> createVideo(const std::shared_ptr<User> owner,
-                                               const std::string &title, const std::string &content) {
-                std::shared_ptr<Video> video =
-                        std::make_shared<BackendVideo>(RandomSequenceGenerator::instance().nextRandomString(5), title);
-                videoContent[video->id] = content;
-                videos.push_back(video);
-                idVideoMap[video->id] = video;
-                owner->addVideo(video);
-                return video;
+            /**
+             * Applies to users created afterwards.
+             */
+            void setInboxSettings(const InboxSettings settings) {
+                inboxSettings = settings;
+            }
+
+            uint64_t nextNotificationSequence() {
+                return ++notificationSequence;
             }
 
-            const SearchEngine<Video> &getVideoSearchEngine() {
-                static SearchEngine<Video> engine([this] {
-                    return videos;
+            /**
+             * Sizes of the stored data; the caller holds the read lock.
+             */
+            MetricsRegistry::Gauges gauges() const {
+                MetricsRegistry::Gauges result = catalog.memoryUsage();
+                size_t pendingNotifications = 0;
+                size_t inboxBytes = 0;
+                for (const std::shared_ptr<User> &user : usersById) {
+                    pendingNotifications += user->getPendingNotifications().size();
+                    inboxBytes += user->getPendingNotifications().memoryUsage();
+                }
+                result.insert(result.end(), {
+                        {"videos",                static_cast<double>(catalog.size())},
+                        {"users",                 static_cast<double>(usersById.size())},
+                        {"sessions",              static_cast<double>(SessionManager::instance().size())},
+                        {"content_bytes",         static_cast<double>(blobs.logicalSize())},
+                        {"content_stored_bytes",  static_cast<double>(blobs.storedSize())},
+                        {"content_blobs",         static_cast<double>(blobs.blobCount())},
+                        {"content_index_bytes",   static_cast<double>(blobs.memoryUsage() - blobs.storedSize())},
+                        {"subscriptions",         static_cast<double>(socialGraph.size())},
+                        {"social_graph_bytes",    static_cast<double>(socialGraph.memoryUsage())},
+                        {"pending_notifications", static_cast<double>(pendingNotifications)},
+                        {"inbox_bytes",           static_cast<double>(inboxBytes)},
+                        {"trending_bytes",        static_cast<double>(trending.memoryUsage())},
+                        {"completion_bytes",      static_cast<double>(videoCompletions.memoryUsage() +
+                                                                      userCompletions.memoryUsage())}
                 });
-                return engine;
+                return result;
             }
 
-            const std::string &findVideoContent(const std::string &id) {
-                return videoContent.at(id);
+            const VideoCatalog &getCatalog() const {
+                return catalog;
             }
 
-            const std::shared_ptr<BackendVideo> findVideo(const std::string &id) {
-                if (idVideoMap.count(id))
-                    return std::dynamic_pointer_cast<BackendVideo>(idVideoMap[id]);
-                return nullptr;
+            std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) const {
+                std::vector<std::shared_ptr<Video>> result;
+                for (const uint32_t video : catalog.search(request))
+                    result.push_back(catalog.view(video));
+                return result;
             }
 
-            void setAuthorized(const std::string& token, const std::shared_ptr<User> user) {
-                authTokens[token] = user;
+            std::string findVideoContent(const std::string &id) const {
+                const uint32_t video = findVideo(id);
+                if (video == VideoCatalog::none)
+                    throw std::out_of_range("no such video");
+                return blobs.read(catalog.content(video));
             }
 
-            const std::shared_ptr<User> getAuthorizedUser(const std::string& token) const {
-                if (authTokens.find(token) == authTokens.end()) {
-                    return nullptr;
-                }
-                return authTokens.at(token);
+            /**
+             * @return catalog index of the video, or VideoCatalog::none
+             */
+            uint32_t findVideo(const uint64_t key) const {
+                return catalog.find(key);
             }
+
+            uint32_t findVideo(const std::string &id) const {
+                uint64_t key;
+                if (!IdCodec::decode(id, key))
+                    return VideoCatalog::none;
+                return findVideo(key);
+            }
+
+            std::shared_ptr<Video> video(const uint32_t index) const {
+                return catalog.view(index);
+            }
+
         };
 
         class NotificationManager {
         private:
-            std::map<std::string, std::vector<std::weak_ptr<ClientCallback>>> callbacks;
+            struct SessionCallback {
+                TokenKey session;
+                std::weak_ptr<ClientCallback> callback;
+            };
 
-            NotificationManager() = default;
+            std::unordered_map<uint32_t, std::vector<SessionCallback>> callbacks;
+            std::mutex mutex;
 
-            const std::unordered_set<std::shared_ptr<ClientCallback>> getUserCallbacks(const std::string &userName) {
+            NotificationManager() {
+                SessionManager::instance().addExpiryListener([this](const TokenKey &session, const uint32_t userId) {
+                    dropSessionCallbacks(userId, session);
+                });
+            }
+
+            const std::unordered_set<std::shared_ptr<ClientCallback>> getUserCallbacks(const uint32_t userId) {
+                std::lock_guard<std::mutex> lock(mutex);
                 std::unordered_set<std::shared_ptr<ClientCallback>> result;
-                if (callbacks.count(userName) != 0) {
-                    std::vector<std::weak_ptr<ClientCallback>> &weakCallbacks = callbacks[userName];
-                    for (auto it = weakCallbacks.begin(); it < weakCallbacks.end(); ++it) {
-                        std::shared_ptr<ClientCallback> callback = it->lock();
+                const auto found = callbacks.find(userId);
+                if (found != callbacks.end()) {
+                    std::vector<SessionCallback> &sessionCallbacks = found->second;
+                    for (auto it = sessionCallbacks.begin(); it != sessionCallbacks.end();) {
+                        std::shared_ptr<ClientCallback> callback = it->callback.lock();
                         if (callback) {
                             result.insert(callback);
+                            ++it;
                         } else {
-                            weakCallbacks.erase(it);
+                            it = sessionCallbacks.erase(it);
                         }
                     }
                 }
@@ -280,82 +430,144 @@ namespace youtube {
                 return manager;
             }
 
-            void addUserCallback(const std::string &userName, const std::shared_ptr<ClientCallback> callback) {
-                callbacks[userName].push_back(std::weak_ptr<ClientCallback>(callback));
+            void addUserCallback(const uint32_t userId, const TokenKey &session,
+                                 const std::shared_ptr<ClientCallback> callback) {
+                std::lock_guard<std::mutex> lock(mutex);
+                callbacks[userId].push_back(SessionCallback{session, std::weak_ptr<ClientCallback>(callback)});
+            }
+
+            void dropSessionCallbacks(const uint32_t userId, const TokenKey &session) {
+                std::lock_guard<std::mutex> lock(mutex);
+                const auto found = callbacks.find(userId);
+                if (found == callbacks.end())
+                    return;
+                std::vector<SessionCallback> &sessionCallbacks = found->second;
+                sessionCallbacks.erase(std::remove_if(sessionCallbacks.begin(), sessionCallbacks.end(),
+                                                      [&session](const SessionCallback &entry) {
+                                                          return entry.session == session;
+                                                      }), sessionCallbacks.end());
+                if (sessionCallbacks.empty())
+                    callbacks.erase(found);
             }
 
-            void notify(const std::string &userName, const std::shared_ptr<Notification> notification) {
-                for (const std::shared_ptr<ClientCallback> callback : getUserCallbacks(userName))
+            void notify(const uint32_t userId, const std::shared_ptr<Notification> notification) {
+                for (const std::shared_ptr<ClientCallback> callback : getUserCallbacks(userId))
                     (*callback)(notification);
             }
         };
 
         class BackendImpl : public Backend {
         private:
-            DataStorage &storage = DataStorage::instance();
+            DataStorage &storage;
+            SessionManager &sessions = SessionManager::instance();
             NotificationManager &notificationManager = NotificationManager::instance();
+            PasswordVerifier &passwordVerifier = PasswordVerifier::instance();
 
-            std::shared_ptr<User> checkCredentials(const std::string &authToken) {
-                const std::shared_ptr<User> user = storage.getAuthorizedUser(authToken);
-                if (!user) {
+            std::shared_ptr<User> checkCredentials(const std::string &authToken, TokenKey &session) {
+                uint32_t userId;
+                if (!IdCodec::decode(authToken, session) || !sessions.validate(session, userId))
+                    throw NotAuthorizedException();
+                const std::shared_ptr<User> user = storage.findUser(userId);
+                if (!user)
                     throw NotAuthorizedException();
-                }
                 return user;
             }
 
+            std::shared_ptr<User> checkCredentials(const std::string &authToken) {
+                TokenKey session;
+                return checkCredentials(authToken, session);
+            }
+
             void
             pushPendingNotifications(const std::shared_ptr<User> user, const std::shared_ptr<ClientCallback> callback) {
-                for (const std::shared_ptr<Notification> &notification: user->getPendingNotifications()) {
-                    (*callback)(notification);
-                }
+                user->getPendingNotifications().forEach([this, &callback](const InboxRecord &record) {
+                    const uint32_t video = storage.findVideo(record.videoKey);
+                    if (video != VideoCatalog::none)
+                        (*callback)(std::make_shared<Notification>(storage.video(video), record.uploads));
+                });
             }
 
             void
-            pushNotificationTo(const std::shared_ptr<User> user, const std::shared_ptr<Notification> notification) {
-                notificationManager.notify(user->name, notification);
-                user->deferNotification(notification);
+            pushNotificationTo(const std::shared_ptr<User> user, const std::shared_ptr<User> creator,
+                               const uint64_t videoKey,
+                               const std::shared_ptr<Notification> notification, const uint64_t sequence) {
+                notificationManager.notify(user->id, notification);
+                user->deferNotification(creator->id, videoKey, sequence);
             }
 
             void
-            pushNotificationFrom(const std::shared_ptr<User> user, const std::shared_ptr<Notification> notification) {
-                for (const std::shared_ptr<User> to : user->getFollowers()) {
-                    pushNotificationTo(to, notification);
-                }
+            pushNotificationFrom(const std::shared_ptr<User> user, const uint32_t video) {
+                const std::shared_ptr<Notification> notification = std::make_shared<Notification>(storage.video(video));
+                const uint64_t videoKey = storage.getCatalog().key(video);
+                const uint64_t sequence = storage.nextNotificationSequence();
+                size_t followers = 0;
+                storage.getSocialGraph().forEachFollower(user->id, [&](const uint32_t followerId) {
+                    pushNotificationTo(storage.findUser(followerId), user, videoKey, notification, sequence);
+                    ++followers;
+                });
+                MetricsRegistry::instance().recordFanOut(followers);
             }
 
         public:
+            explicit BackendImpl(DataStorage &storage = DataStorage::instance()) : storage(storage) {}
+
             const std::string auth(const std::string &name, const std::string &password) override {
-                const std::shared_ptr<User> user = storage.findUser(name);
+                const std::shared_ptr<User> user = [&] {
+                    const auto lock = storage.readLock();
+                    return storage.findUser(name);
+                }();
                 if (!user) {
                     throw NoSuchUserException();
                 }
-                if (!user->checkPassword(password)) {
-                    throw WrongPasswordException();
+                switch (passwordVerifier.verify(user->id, password, user->getPasswordHash())) {
+                    case PasswordVerifier::Verdict::Accepted:
+                        break;
+                    case PasswordVerifier::Verdict::Rejected:
+                        throw WrongPasswordException();
+                    case PasswordVerifier::Verdict::Overloaded:
+                        throw ServiceOverloadedException();
+                }
+                return IdCodec::encode(sessions.open(user->id));
+            }
+
+            void logout(const std::string &authToken) override {
+                TokenKey session;
+                {
+                    const auto lock = storage.readLock();
+                    checkCredentials(authToken, session);
                 }
-                const std::string token = RandomSequenceGenerator::instance().nextRandomString(7);
-                storage.setAuthorized(token, user);
-                return token;
+                sessions.close(session);
             }
 
             void registerUser(const std::string &name, const std::string &password) override {
-                const std::shared_ptr<User> user = storage.findUser(name);
-                if (user)
+                {
+                    const auto lock = storage.readLock();
+                    if (storage.findUser(name))
+                        throw UserAlreadyExistsException();
+                }
+                PasswordHash hash;
+                if (!passwordVerifier.hash(password, hash))
+                    throw ServiceOverloadedException();
+                const auto lock = storage.writeLock();
+                if (storage.findUser(name))
                     throw UserAlreadyExistsException();
-                storage.createUser(name, password);
+                storage.createUser(name, hash);
             }
 
             void addVideo(const std::string &authToken,
                           const std::string &name, const std::string &content) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
-                std::shared_ptr<Video> video = storage.createVideo(user, name, content);
-                pushNotificationFrom(user, std::make_shared<Notification>(video));
+                pushNotificationFrom(user, storage.createVideo(user, name, content));
             }
 
             const std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) override {
-                return storage.getVideoSearchEngine().search(request);
+                const auto lock = storage.readLock();
+                return storage.searchVideos(request);
             }
 
             const std::string downloadVideo(const std::string &id) override {
+                const auto lock = storage.readLock();
                 try {
                     return storage.findVideoContent(id);
                 } catch (const std::out_of_range &exc) {
@@ -364,93 +576,290 @@ namespace youtube {
             }
 
             const std::shared_ptr<Video> getVideo(const std::string &id) override {
-                const std::shared_ptr<BackendVideo> result = storage.findVideo(id);
-                if (!result)
+                const auto lock = storage.readLock();
+                const uint32_t video = storage.findVideo(id);
+                if (video == VideoCatalog::none)
                     throw NoSuchVideoException();
-                return result;
+                return storage.video(video);
             }
 
             void leaveComment(const std::string &authToken, const std::string &videoId,
                               const std::string &comment) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
-                const std::shared_ptr<BackendVideo> video = storage.findVideo(videoId);
-                if (!video)
+                const uint32_t video = storage.findVideo(videoId);
+                if (video == VideoCatalog::none)
                     throw NoSuchVideoException();
-                video->addComment(std::make_shared<BackendComment>(user->name, comment));
+                storage.addComment(video, user->name, comment);
             }
 
             void leaveComment(const std::string &authToken, const std::string &videoId,
                               const std::string &comment, const size_t replyToIndex) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
-                const std::shared_ptr<BackendVideo> video = storage.findVideo(videoId);
-                if (!video)
+                const uint32_t video = storage.findVideo(videoId);
+                if (video == VideoCatalog::none)
                     throw NoSuchVideoException();
-                const std::vector<std::shared_ptr<Comment>> &comments = video->getComments();
-                if (comments.size() <= replyToIndex)
+                if (storage.getCatalog().commentCount(video) <= replyToIndex)
                     throw NoSuchCommentException();
-                const std::shared_ptr<BackendComment> reply = std::make_shared<BackendComment>(user->name, comment);
-                std::dynamic_pointer_cast<BackendComment>(comments[replyToIndex])->addReply(reply);
+                storage.addReply(video, replyToIndex, user->name, comment);
             }
 
             void leaveLike(const std::string &authToken, const std::string &videoId) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
-                const std::shared_ptr<BackendVideo> video = storage.findVideo(videoId);
-                if (!video)
+                const uint32_t video = storage.findVideo(videoId);
+                if (video == VideoCatalog::none)
                     throw NoSuchVideoException();
-                video->like(user->name);
+                storage.likeVideo(video, user->name);
             }
 
             void leaveLike(const std::string &authToken, const std::string &videoId, const size_t commentId) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
-                const std::shared_ptr<BackendVideo> video = storage.findVideo(videoId);
-                if (!video)
+                const uint32_t video = storage.findVideo(videoId);
+                if (video == VideoCatalog::none)
                     throw NoSuchVideoException();
-                const std::vector<std::shared_ptr<Comment>> &comments = video->getComments();
-                if (comments.size() <= commentId)
+                if (storage.getCatalog().commentCount(video) <= commentId)
                     throw NoSuchCommentException();
-                std::dynamic_pointer_cast<BackendComment>(comments[commentId])->like(user->name);
+                storage.likeComment(video, commentId, user->name);
             }
 
             void
             setClientCallback(const std::string &authToken, const std::shared_ptr<ClientCallback> callback) override {
-                std::shared_ptr<User> user = checkCredentials(authToken);
-                notificationManager.addUserCallback(user->name, callback);
+                const auto lock = storage.writeLock();
+                TokenKey session;
+                std::shared_ptr<User> user = checkCredentials(authToken, session);
+                notificationManager.addUserCallback(user->id, session, callback);
                 pushPendingNotifications(user, callback);
             }
 
-            void subscribeFor(const std::string &authToken, const std::string &userName) {
+            void subscribeFor(const std::string &authToken, const std::string &userName) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
                 std::shared_ptr<User> subscription = storage.findUser(userName);
                 if (!subscription)
                     throw NoSuchUserException();
-                user->addSubscription(subscription);
+                storage.subscribe(user->id, subscription->id);
             }
 
-            void releasePendingNotifications(const std::string &authToken) {
+            void unsubscribeFrom(const std::string &authToken, const std::string &userName) override {
+                const auto lock = storage.writeLock();
+                std::shared_ptr<User> user = checkCredentials(authToken);
+                std::shared_ptr<User> subscription = storage.findUser(userName);
+                if (!subscription)
+                    throw NoSuchUserException();
+                storage.unsubscribe(user->id, subscription->id);
+            }
+
+            void releasePendingNotifications(const std::string &authToken) override {
+                const auto lock = storage.writeLock();
                 std::shared_ptr<User> user = checkCredentials(authToken);
                 user->releasePendingNotifications();
             }
+
+            const Completions complete(const std::string &prefix, const size_t count) override {
+                const auto lock = storage.readLock();
+                return storage.complete(prefix, count);
+            }
+
+            const std::vector<TrendingVideo> getTrending(const TrendingWindow window, const size_t count) override {
+                const auto lock = storage.readLock();
+                std::vector<TrendingVideo> result;
+                for (const TrendingIndex::Entry &entry : storage.getTrending().top(window, count)) {
+                    const uint32_t video = storage.findVideo(entry.key);
+                    if (video != VideoCatalog::none)
+                        result.push_back(TrendingVideo{storage.video(video), entry.events});
+                }
+                return result;
+            }
         };
 
 
+        /**
+         * In-process copy of the primary storage, fed from a ReplicationLog by a background thread.
+         * Mutations are applied in batches under the replica's own write lock, so readers of a replica
+         * never wait for writers on the primary.
+         */
+        class Replica {
+        private:
+            static constexpr size_t maxBatch = 256;
+
+            const std::shared_ptr<ReplicationLog> log;
+            const size_t reader;
+            DataStorage storage;
+            const std::shared_ptr<BackendImpl> backend;
+            std::atomic<uint64_t> applied{0};
+            std::thread thread;
+
+            void applyLoop() {
+                std::vector<ReplicationLog::Entry> batch;
+                while (log->read(reader, batch, maxBatch)) {
+                    {
+                        const auto lock = storage.writeLock();
+                        for (const ReplicationLog::Entry &mutation : batch)
+                            storage.apply(*mutation);
+                    }
+                    applied.store(batch.back()->sequence, std::memory_order_release);
+                    log->acknowledge(reader, batch.back()->sequence);
+                }
+            }
+
+        public:
+            /**
+             * Starts following the log; create replicas before the primary takes writes.
+             */
+            explicit Replica(std::shared_ptr<ReplicationLog> log)
+                    : log(std::move(log)), reader(this->log->addReader()),
+                      backend(std::make_shared<BackendImpl>(storage)) {
+                thread = std::thread([this] { applyLoop(); });
+            }
+
+            Replica(const Replica &) = delete;
+
+            ~Replica() {
+                log->stopReader(reader);
+                thread.join();
+            }
+
+            /**
+             * Serves reads only: writes sent here would never reach the primary.
+             */
+            std::shared_ptr<Backend> getBackend() const {
+                return backend;
+            }
+
+            uint64_t appliedSequence() const {
+                return applied.load(std::memory_order_acquire);
+            }
+
+            uint64_t lag() const {
+                return log->lastSequence() - appliedSequence();
+            }
+        };
+
+        /**
+         * Last primary sequence each session has written. Sharded by token so that reads do not
+         * serialize on one lock; sessions whose writes every replica has applied are pruned.
+         */
+        class SessionWatermarks {
+        private:
+            static constexpr size_t shardCount = 64;
+            static constexpr size_t pruneThreshold = 1024;
+
+            struct alignas(64) Shard {
+                std::mutex mutex;
+                std::unordered_map<std::string, uint64_t> sequences;
+            };
+
+            std::array<Shard, shardCount> shards;
+
+            Shard &shardOf(const std::string &authToken) {
+                return shards[std::hash<std::string>()(authToken) % shardCount];
+            }
+
+        public:
+            /**
+             * @param settled sequence applied by every replica; older watermarks are no longer needed
+             */
+            void advance(const std::string &authToken, const uint64_t sequence, const uint64_t settled) {
+                Shard &shard = shardOf(authToken);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (shard.sequences.size() >= pruneThreshold) {
+                    for (auto it = shard.sequences.begin(); it != shard.sequences.end();)
+                        it = it->second <= settled ? shard.sequences.erase(it) : std::next(it);
+                }
+                uint64_t &watermark = shard.sequences[authToken];
+                watermark = std::max(watermark, sequence);
+            }
+
+            uint64_t get(const std::string &authToken) {
+                Shard &shard = shardOf(authToken);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                const auto found = shard.sequences.find(authToken);
+                return found == shard.sequences.end() ? 0 : found->second;
+            }
+
+            void forget(const std::string &authToken) {
+                Shard &shard = shardOf(authToken);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.sequences.erase(authToken);
+            }
+        };
+
+        /**
+         * A replica as seen by Proxy: the backend to read from, possibly decorated, and its progress.
+         */
+        struct ReadReplica {
+            std::shared_ptr<Backend> backend;
+            std::shared_ptr<const Replica> replica;
+        };
+
+        /**
+         * Spreads calls over the primary backends round-robin. With replicas, getVideo, searchVideos and
+         * downloadVideo go to a replica instead, picked round-robin among those that have applied every
+         * write of the calling session; if none has caught up yet the read falls back to a primary.
+         */
         class Proxy : public Backend {
         private:
             const std::vector<std::shared_ptr<Backend>> backends;
-            size_t roundRobinIndex = 0;
+            const std::vector<ReadReplica> replicas;
+            const std::shared_ptr<ReplicationLog> log;
+            std::atomic<size_t> roundRobinIndex{0};
+            std::atomic<size_t> replicaIndex{0};
+            SessionWatermarks watermarks;
 
             const std::shared_ptr<Backend> nextBackend() {
                 return backends[(++roundRobinIndex) % backends.size()];
             }
 
+            const std::shared_ptr<Backend> readBackend(const std::string &authToken) {
+                if (replicas.empty())
+                    return nextBackend();
+                const uint64_t required = authToken.empty() ? 0 : watermarks.get(authToken);
+                const size_t start = ++replicaIndex;
+                for (size_t i = 0; i < replicas.size(); ++i) {
+                    const ReadReplica &candidate = replicas[(start + i) % replicas.size()];
+                    if (candidate.replica->appliedSequence() >= required)
+                        return candidate.backend;
+                }
+                return nextBackend();
+            }
+
+            void wrote(const std::string &authToken) {
+                if (replicas.empty())
+                    return;
+                uint64_t settled = UINT64_MAX;
+                for (const ReadReplica &replica : replicas)
+                    settled = std::min(settled, replica.replica->appliedSequence());
+                watermarks.advance(authToken, log->lastSequence(), settled);
+            }
+
         public:
             Proxy(const std::vector<std::shared_ptr<Backend>> &backends) : backends(backends) {}
 
+            /**
+             * @param log the log the primary storage behind backends writes to and replicas follow
+             */
+            Proxy(const std::vector<std::shared_ptr<Backend>> &backends, const std::vector<ReadReplica> &replicas,
+                  std::shared_ptr<ReplicationLog> log)
+                    : backends(backends), replicas(replicas), log(std::move(log)) {}
+
             const std::string auth(const std::string &name, const std::string &password) override {
                 return nextBackend()->auth(name, password);
             }
 
+            void logout(const std::string &authToken) override {
+                nextBackend()->logout(authToken);
+                watermarks.forget(authToken);
+            }
+
             const std::string downloadVideo(const std::string &id) override {
-                return nextBackend()->downloadVideo(id);
+                return readBackend(std::string())->downloadVideo(id);
+            }
+
+            const std::string downloadVideo(const std::string &authToken, const std::string &id) override {
+                return readBackend(authToken)->downloadVideo(id);
             }
 
             void registerUser(const std::string &name, const std::string &password) override {
@@ -458,33 +867,47 @@ namespace youtube {
             }
 
             const std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) override {
-                return nextBackend()->searchVideos(request);
+                return readBackend(std::string())->searchVideos(request);
+            }
+
+            const std::vector<std::shared_ptr<Video>>
+            searchVideos(const std::string &authToken, const std::vector<std::string> &request) override {
+                return readBackend(authToken)->searchVideos(request);
             }
 
             void addVideo(const std::string &authToken, const std::string &name, const std::string &content) override {
                 nextBackend()->addVideo(authToken, name, content);
+                wrote(authToken);
             }
 
             const std::shared_ptr<Video> getVideo(const std::string &id) override {
-                return nextBackend()->getVideo(id);
+                return readBackend(std::string())->getVideo(id);
+            }
+
+            const std::shared_ptr<Video> getVideo(const std::string &authToken, const std::string &id) override {
+                return readBackend(authToken)->getVideo(id);
             }
 
             void leaveComment(const std::string &authToken, const std::string &videoId,
                               const std::string &comment) override {
                 nextBackend()->leaveComment(authToken, videoId, comment);
+                wrote(authToken);
             }
 
             void leaveComment(const std::string &authToken, const std::string &videoId, const std::string &comment,
                               size_t replyToIndex) override {
                 nextBackend()->leaveComment(authToken, videoId, comment, replyToIndex);
+                wrote(authToken);
             }
 
             void leaveLike(const std::string &authToken, const std::string &videoId) override {
                 nextBackend()->leaveLike(authToken, videoId);
+                wrote(authToken);
             }
 
             void leaveLike(const std::string &authToken, const std::string &videoId, size_t likeId) override {
                 nextBackend()->leaveLike(authToken, videoId, likeId);
+                wrote(authToken);
             }
 
             void
@@ -494,11 +917,162 @@ namespace youtube {
 
             void subscribeFor(const std::string &authToken, const std::string &userName) override {
                 nextBackend()->subscribeFor(authToken, userName);
+                wrote(authToken);
+            }
+
+            void unsubscribeFrom(const std::string &authToken, const std::string &userName) override {
+                nextBackend()->unsubscribeFrom(authToken, userName);
+                wrote(authToken);
             }
 
             void releasePendingNotifications(const std::string &authToken) override {
                 nextBackend()->releasePendingNotifications(authToken);
             }
+
+            const std::vector<TrendingVideo> getTrending(const TrendingWindow window, const size_t count) override {
+                return readBackend(std::string())->getTrending(window, count);
+            }
+
+            const Completions complete(const std::string &prefix, const size_t count) override {
+                return readBackend(std::string())->complete(prefix, count);
+            }
+        };
+
+        /**
+         * Decorator recording per-method call counts, errors and latencies of the wrapped backend
+         * into MetricsRegistry, tagged with the partition name.
+         */
+        class InstrumentedBackend : public Backend {
+        private:
+            using Method = MetricsRegistry::Method;
+            using Clock = std::chrono::steady_clock;
+
+            const std::shared_ptr<Backend> backend;
+            MetricsRegistry &registry = MetricsRegistry::instance();
+            const size_t partition;
+
+            template<class F>
+            auto measure(const Method method, F &&call) -> decltype(call()) {
+                MetricsRegistry::MethodStats &stats = registry.methodStats(partition, method);
+                const bool timed = stats.begin(registry.latencySampleMask());
+                bool failed = true;
+                struct Recorder {
+                    MetricsRegistry::MethodStats &stats;
+                    const bool timed;
+                    const Clock::time_point start;
+                    const bool &failed;
+
+                    ~Recorder() {
+                        if (timed) {
+                            const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    Clock::now() - start).count();
+                            stats.latency.record(static_cast<uint64_t>(nanos));
+                        }
+                        if (failed)
+                            stats.fail();
+                    }
+                } recorder{stats, timed, timed ? Clock::now() : Clock::time_point(), failed};
+                if constexpr (std::is_void_v<decltype(call())>) {
+                    call();
+                    failed = false;
+                } else {
+                    auto result = call();
+                    failed = false;
+                    return result;
+                }
+            }
+
+        public:
+            InstrumentedBackend(const std::string &partitionName, std::shared_ptr<Backend> backend)
+                    : backend(std::move(backend)), partition(registry.registerPartition(partitionName)) {}
+
+            const std::string auth(const std::string &name, const std::string &password) override {
+                return measure(Method::Auth, [&] { return backend->auth(name, password); });
+            }
+
+            void logout(const std::string &authToken) override {
+                measure(Method::Logout, [&] { backend->logout(authToken); });
+            }
+
+            const std::string downloadVideo(const std::string &id) override {
+                return measure(Method::DownloadVideo, [&] { return backend->downloadVideo(id); });
+            }
+
+            void registerUser(const std::string &name, const std::string &password) override {
+                measure(Method::RegisterUser, [&] { backend->registerUser(name, password); });
+            }
+
+            const std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) override {
+                return measure(Method::SearchVideos, [&] { return backend->searchVideos(request); });
+            }
+
+            void addVideo(const std::string &authToken, const std::string &name, const std::string &content) override {
+                measure(Method::AddVideo, [&] { backend->addVideo(authToken, name, content); });
+            }
+
+            const std::shared_ptr<Video> getVideo(const std::string &id) override {
+                return measure(Method::GetVideo, [&] { return backend->getVideo(id); });
+            }
+
+            void leaveComment(const std::string &authToken, const std::string &videoId,
+                              const std::string &comment) override {
+                measure(Method::LeaveComment, [&] { backend->leaveComment(authToken, videoId, comment); });
+            }
+
+            void leaveComment(const std::string &authToken, const std::string &videoId, const std::string &comment,
+                              size_t replyToIndex) override {
+                measure(Method::LeaveReply, [&] {
+                    backend->leaveComment(authToken, videoId, comment, replyToIndex);
+                });
+            }
+
+            void leaveLike(const std::string &authToken, const std::string &videoId) override {
+                measure(Method::LeaveLike, [&] { backend->leaveLike(authToken, videoId); });
+            }
+
+            void leaveLike(const std::string &authToken, const std::string &videoId, size_t likeId) override {
+                measure(Method::LikeComment, [&] { backend->leaveLike(authToken, videoId, likeId); });
+            }
+
+            void
+            setClientCallback(const std::string &authToken, const std::shared_ptr<ClientCallback> callback) override {
+                measure(Method::SetClientCallback, [&] { backend->setClientCallback(authToken, callback); });
+            }
+
+            void subscribeFor(const std::string &authToken, const std::string &userName) override {
+                measure(Method::SubscribeFor, [&] { backend->subscribeFor(authToken, userName); });
+            }
+
+            void unsubscribeFrom(const std::string &authToken, const std::string &userName) override {
+                measure(Method::UnsubscribeFrom, [&] { backend->unsubscribeFrom(authToken, userName); });
+            }
+
+            void releasePendingNotifications(const std::string &authToken) override {
+                measure(Method::ReleasePendingNotifications, [&] {
+                    backend->releasePendingNotifications(authToken);
+                });
+            }
+
+            const std::vector<TrendingVideo> getTrending(const TrendingWindow window, const size_t count) override {
+                return measure(Method::GetTrending, [&] { return backend->getTrending(window, count); });
+            }
+
+            const Completions complete(const std::string &prefix, const size_t count) override {
+                return measure(Method::Complete, [&] { return backend->complete(prefix, count); });
+            }
+
+            const std::string downloadVideo(const std::string &authToken, const std::string &id) override {
+                return measure(Method::DownloadVideo, [&] { return backend->downloadVideo(authToken, id); });
+            }
+
+            const std::vector<std::shared_ptr<Video>>
+            searchVideos(const std::string &authToken, const std::vector<std::string> &request) override {
+                return measure(Method::SearchVideos, [&] { return backend->searchVideos(authToken, request); });
+            }
+
+            const std::shared_ptr<Video> getVideo(const std::string &authToken, const std::string &id) override {
+                return measure(Method::GetVideo, [&] { return backend->getVideo(authToken, id); });
+            }
         };
     }
 }
@@ -0,0 +1,1039 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backend.h"
+#include "client.h"
+#include "metrics.h"
+#include "remote-backend.h"
+#include "rpc-server.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    size_t threads = 4;
+    size_t users = 0;
+    size_t rounds = 2;
+    size_t follows = 200;
+    size_t videos = 2000;
+    size_t operations = 20000;
+    size_t readPercent = 90;
+    size_t contentSize = 1024;
+    double zipf = 0.99;
+    std::string json;
+
+    size_t usersOr(const size_t scenarioDefault) const {
+        return users ? users : scenarioDefault;
+    }
+};
+
+uint64_t elapsedNanos(const BenchClock::time_point begin) {
+    return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - begin).count());
+}
+
+double elapsedSeconds(const BenchClock::time_point begin) {
+    return std::chrono::duration<double>(BenchClock::now() - begin).count();
+}
+
+/**
+ * Zipf-distributed ranks in [0, n): rank 0 is the most popular.
+ */
+class ZipfDistribution {
+private:
+    std::vector<double> cdf;
+
+public:
+    ZipfDistribution(const size_t n, const double exponent) : cdf(std::max<size_t>(n, 1)) {
+        double total = 0;
+        for (size_t i = 0; i < cdf.size(); ++i)
+            cdf[i] = total += 1.0 / std::pow(static_cast<double>(i + 1), exponent);
+        for (double &value : cdf)
+            value /= total;
+    }
+
+    size_t operator()(RandomSequenceGenerator &random) const {
+        const double u = static_cast<double>(random.nextUInt64() >> 11) * 0x1.0p-53;
+        return std::min<size_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin(), cdf.size() - 1);
+    }
+};
+
+/**
+ * Results of one scenario, printed for humans and optionally written as JSON.
+ */
+class BenchReport {
+private:
+    struct Entry {
+        std::string name;
+        uint64_t operations;
+        double seconds;
+        std::shared_ptr<youtube::LatencyHistogram> latency;
+        std::vector<std::pair<std::string, double>> extra;
+    };
+
+    const std::string scenario;
+    std::vector<std::pair<std::string, double>> parameters;
+    std::vector<Entry> entries;
+
+    static void writeJsonString(std::ostream &out, const std::string &value) {
+        out << '"';
+        for (const char c : value) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+
+public:
+    explicit BenchReport(std::string scenario) : scenario(std::move(scenario)) {}
+
+    void addParameter(const std::string &name, const double value) {
+        parameters.emplace_back(name, value);
+    }
+
+    void addLatency(const std::string &name, const youtube::LatencyHistogram &latency, const double seconds) {
+        entries.push_back(Entry{name, latency.count(), seconds,
+                                std::make_shared<youtube::LatencyHistogram>(latency), {}});
+    }
+
+    void addThroughput(const std::string &name, const uint64_t operations, const double seconds,
+                       std::vector<std::pair<std::string, double>> extra = {}) {
+        entries.push_back(Entry{name, operations, seconds, nullptr, std::move(extra)});
+    }
+
+    void print(std::ostream &out) const {
+        for (const Entry &entry : entries) {
+            out << entry.name << ": " << entry.operations << " ops in " << entry.seconds << " s, "
+                << static_cast<double>(entry.operations) / entry.seconds << " ops/s";
+            if (entry.latency) {
+                out << ", latency us p50=" << entry.latency->valueAt(0.50) / 1000.0
+                    << " p99=" << entry.latency->valueAt(0.99) / 1000.0
+                    << " p999=" << entry.latency->valueAt(0.999) / 1000.0
+                    << " max=" << entry.latency->max() / 1000.0;
+            }
+            for (const auto &field : entry.extra)
+                out << ", " << field.first << '=' << field.second;
+            out << '\n';
+        }
+    }
+
+    void writeJson(std::ostream &out) const {
+        out << "{\n  \"scenario\": ";
+        writeJsonString(out, scenario);
+        out << ",\n  \"parameters\": {";
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            out << (i ? ", " : "");
+            writeJsonString(out, parameters[i].first);
+            out << ": " << parameters[i].second;
+        }
+        out << "},\n  \"results\": [";
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const Entry &entry = entries[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": ";
+            writeJsonString(out, entry.name);
+            out << ", \"operations\": " << entry.operations << ", \"seconds\": " << entry.seconds
+                << ", \"throughput\": " << static_cast<double>(entry.operations) / entry.seconds;
+            if (entry.latency) {
+                const youtube::LatencyHistogram &latency = *entry.latency;
+                out << ", \"latency_ns\": {\"mean\": " << latency.mean()
+                    << ", \"min\": " << latency.min()
+                    << ", \"p50\": " << latency.valueAt(0.50)
+                    << ", \"p90\": " << latency.valueAt(0.90)
+                    << ", \"p99\": " << latency.valueAt(0.99)
+                    << ", \"p999\": " << latency.valueAt(0.999)
+                    << ", \"max\": " << latency.max() << '}';
+            }
+            for (const auto &field : entry.extra) {
+                out << ", ";
+                writeJsonString(out, field.first);
+                out << ": " << field.second;
+            }
+            out << '}';
+        }
+        out << "\n  ]\n}\n";
+    }
+};
+
+std::shared_ptr<youtube::Backend> makeBackend() {
+    return std::make_shared<youtube::backend::Proxy>(
+            std::vector<std::shared_ptr<youtube::Backend>>{
+                    std::make_shared<youtube::backend::BackendImpl>(),
+                    std::make_shared<youtube::backend::BackendImpl>(),
+                    std::make_shared<youtube::backend::BackendImpl>()
+            });
+}
+
+std::string userName(const size_t index) {
+    return "user" + std::to_string(index);
+}
+
+/**
+ * Concurrent logins through Proxy: the first round pays the full password work factor,
+ * subsequent rounds hit the short-lived verification cache.
+ */
+void benchAuth(const BenchOptions &options, BenchReport &report) {
+    const size_t users = options.usersOr(200);
+    report.addParameter("users", users);
+    report.addParameter("threads", options.threads);
+    const std::shared_ptr<youtube::Backend> backend = makeBackend();
+
+    for (size_t i = 0; i < users; ++i)
+        backend->registerUser(userName(i), "password" + std::to_string(i));
+
+    for (size_t round = 0; round < options.rounds; ++round) {
+        std::vector<youtube::LatencyHistogram> perThread(options.threads);
+        std::atomic<size_t> nextUser{0};
+        std::atomic<size_t> overloaded{0};
+        const BenchClock::time_point start = BenchClock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < options.threads; ++t) {
+            threads.emplace_back([&, t] {
+                for (size_t i = nextUser++; i < users; i = nextUser++) {
+                    const BenchClock::time_point begin = BenchClock::now();
+                    try {
+                        backend->auth(userName(i), "password" + std::to_string(i));
+                    } catch (const youtube::backend::ServiceOverloadedException &) {
+                        ++overloaded;
+                        continue;
+                    }
+                    perThread[t].record(elapsedNanos(begin));
+                }
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+
+        const double seconds = elapsedSeconds(start);
+        youtube::LatencyHistogram latency;
+        for (const youtube::LatencyHistogram &part : perThread)
+            latency.add(part);
+        report.addLatency(round == 0 ? "auth (cold)" : "auth (cached)", latency, seconds);
+        if (overloaded)
+            report.addThroughput("auth rejected as overloaded", overloaded, seconds);
+    }
+}
+
+/**
+ * Builds a follower graph edge by edge, then measures fan-out iteration and unsubscribes.
+ */
+void benchGraph(const BenchOptions &options, BenchReport &report) {
+    const size_t users = options.usersOr(1000000);
+    report.addParameter("users", users);
+    report.addParameter("follows", options.follows);
+    youtube::backend::SocialGraph graph;
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t follower = 0; follower < users; ++follower)
+        for (size_t i = 0; i < options.follows; ++i)
+            graph.subscribe(static_cast<uint32_t>(follower), static_cast<uint32_t>(random.nextUInt64() % users));
+    report.addThroughput("subscribe", graph.size(), elapsedSeconds(start),
+                         {{"bytes_per_edge", static_cast<double>(graph.memoryUsage()) / graph.size()}});
+
+    start = BenchClock::now();
+    uint64_t visited = 0, checksum = 0;
+    for (size_t creator = 0; creator < users; ++creator) {
+        graph.forEachFollower(static_cast<uint32_t>(creator), [&](const uint32_t follower) {
+            ++visited;
+            checksum += follower;
+        });
+    }
+    report.addThroughput("fan-out", visited, elapsedSeconds(start), {{"checksum", static_cast<double>(checksum)}});
+
+    const size_t removals = std::min<size_t>(users, 1000000);
+    start = BenchClock::now();
+    size_t removed = 0;
+    for (size_t i = 0; i < removals; ++i) {
+        const auto follower = static_cast<uint32_t>(random.nextUInt64() % users);
+        uint32_t creator = 0;
+        graph.forEachSubscription(follower, [&creator](const uint32_t to) { creator = to; });
+        removed += graph.unsubscribe(follower, creator);
+    }
+    report.addThroughput("unsubscribe", removed, elapsedSeconds(start));
+}
+
+/**
+ * Synthetic mixed workload: concurrent clients from StandardYoutubeClientFactory issue reads and
+ * writes against Zipf-popular videos, on top of a follower graph skewed towards popular creators.
+ */
+void benchLoad(const BenchOptions &options, BenchReport &report) {
+    const size_t users = options.usersOr(200);
+    report.addParameter("users", users);
+    report.addParameter("threads", options.threads);
+    report.addParameter("videos", options.videos);
+    report.addParameter("operations_per_client", options.operations);
+    report.addParameter("read_percent", options.readPercent);
+    report.addParameter("zipf", options.zipf);
+
+    const std::shared_ptr<youtube::Backend> backend = makeBackend();
+    youtube::client::StandardYoutubeClientFactory factory{backend};
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+    const ZipfDistribution creatorPopularity(users, options.zipf);
+    const ZipfDistribution videoPopularity(options.videos, options.zipf);
+    const size_t tagCount = 100;
+    const ZipfDistribution tagPopularity(tagCount, options.zipf);
+    const std::string content(options.contentSize, 'x');
+
+    BenchClock::time_point start = BenchClock::now();
+    {
+        youtube::client::YoutubeClient setup = factory.openConnection();
+        for (size_t i = 0; i < users; ++i)
+            setup.registerUser(userName(i), "password");
+        const size_t follows = std::min(options.follows, users / 2);
+        for (size_t i = 0; i < users; ++i) {
+            setup.auth(userName(i), "password");
+            for (size_t j = 0; j < follows; ++j)
+                setup.subscribeFor(userName(creatorPopularity(random)));
+        }
+        for (size_t i = 0; i < options.videos; ++i) {
+            setup.auth(userName(creatorPopularity(random)), "password");
+            setup.uploadVideo("video " + std::to_string(i) + " tag" + std::to_string(tagPopularity(random)),
+                              content);
+        }
+    }
+    std::vector<std::string> videoIds;
+    for (const std::shared_ptr<youtube::Video> &video : backend->searchVideos({"video"}))
+        videoIds.push_back(video->id);
+    report.addThroughput("setup", users + options.videos, elapsedSeconds(start));
+
+    enum Operation {
+        GetVideo, DownloadVideo, SearchVideos, LeaveLike, LeaveComment, AddVideo, SubscribeFor, OperationCount
+    };
+    const char *operationNames[] = {
+            "getVideo", "downloadVideo", "searchVideos", "leaveLike", "leaveComment", "addVideo", "subscribeFor"
+    };
+
+    std::vector<std::vector<youtube::LatencyHistogram>> latencies(
+            options.threads, std::vector<youtube::LatencyHistogram>(OperationCount));
+    std::atomic<size_t> errors{0};
+
+    start = BenchClock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < options.threads; ++t) {
+        threads.emplace_back([&, t] {
+            RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+            youtube::client::YoutubeClient client = factory.openConnection();
+            client.auth(userName(t % users), "password");
+
+            for (size_t i = 0; i < options.operations; ++i) {
+                const uint64_t dice = random.nextUInt64() % 100;
+                Operation operation;
+                if (dice < options.readPercent) {
+                    const uint64_t kind = random.nextUInt64() % 10;
+                    operation = kind < 5 ? GetVideo : kind < 8 ? DownloadVideo : SearchVideos;
+                } else {
+                    const uint64_t kind = random.nextUInt64() % 20;
+                    operation = kind < 10 ? LeaveLike : kind < 16 ? LeaveComment : kind < 19 ? AddVideo : SubscribeFor;
+                }
+                const std::string &videoId = videoIds[videoPopularity(random) % videoIds.size()];
+
+                const BenchClock::time_point begin = BenchClock::now();
+                try {
+                    switch (operation) {
+                        case GetVideo:
+                            client.getVideo(videoId);
+                            break;
+                        case DownloadVideo:
+                            client.downloadVideo(videoId);
+                            break;
+                        case SearchVideos:
+                            client.searchVideos({"tag" + std::to_string(tagPopularity(random))});
+                            break;
+                        case LeaveLike:
+                            client.likeVideo(videoId);
+                            break;
+                        case LeaveComment:
+                            client.leaveComment(videoId, "nice");
+                            break;
+                        case AddVideo:
+                            client.uploadVideo("fresh video tag" + std::to_string(tagPopularity(random)), content);
+                            break;
+                        default:
+                            client.subscribeFor(userName(creatorPopularity(random)));
+                            break;
+                    }
+                } catch (const std::exception &) {
+                    ++errors;
+                }
+                latencies[t][operation].record(elapsedNanos(begin));
+            }
+            client.getAndReleaseNotifications();
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    const double seconds = elapsedSeconds(start);
+
+    youtube::LatencyHistogram all;
+    for (size_t operation = 0; operation < OperationCount; ++operation) {
+        youtube::LatencyHistogram merged;
+        for (size_t t = 0; t < options.threads; ++t)
+            merged.add(latencies[t][operation]);
+        all.add(merged);
+        report.addLatency(operationNames[operation], merged, seconds);
+    }
+    report.addLatency("all", all, seconds);
+    report.addThroughput("errors", errors, seconds);
+}
+
+/**
+ * Cost of InstrumentedBackend: the same getVideo loop with and without the decorator.
+ */
+void benchOverhead(const BenchOptions &options, BenchReport &report) {
+    const size_t calls = options.operations * 50;
+    report.addParameter("calls", calls);
+    const auto direct = std::make_shared<youtube::backend::BackendImpl>();
+    const auto instrumented = std::make_shared<youtube::backend::InstrumentedBackend>("bench", direct);
+
+    direct->registerUser("overhead", "password");
+    const std::string token = direct->auth("overhead", "password");
+    direct->addVideo(token, "overhead video", "content");
+    const std::string videoId = direct->searchVideos({"overhead"}).front()->id;
+
+    double nanosPerCall[2];
+    const std::shared_ptr<youtube::Backend> variants[2] = {direct, instrumented};
+    for (size_t round = 0; round < 3; ++round) {
+        for (size_t variant = 0; variant < 2; ++variant) {
+            const BenchClock::time_point start = BenchClock::now();
+            for (size_t i = 0; i < calls; ++i)
+                variants[variant]->getVideo(videoId);
+            nanosPerCall[variant] = static_cast<double>(elapsedNanos(start)) / static_cast<double>(calls);
+        }
+    }
+    report.addThroughput("getVideo direct", calls, nanosPerCall[0] * calls / 1e9,
+                         {{"ns_per_call", nanosPerCall[0]}});
+    report.addThroughput("getVideo instrumented", calls, nanosPerCall[1] * calls / 1e9,
+                         {{"ns_per_call", nanosPerCall[1]}, {"overhead_ns", nanosPerCall[1] - nanosPerCall[0]}});
+}
+
+/**
+ * Cost of one trending event and of a top-N query, with Zipf-popular keys out of many videos.
+ */
+void benchTrending(const BenchOptions &options, BenchReport &report) {
+    const size_t events = options.operations * 100;
+    const size_t videos = options.videos * 500;
+    report.addParameter("events", events);
+    report.addParameter("videos", videos);
+    report.addParameter("zipf", options.zipf);
+    const ZipfDistribution popularity(videos, options.zipf);
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+    std::vector<uint64_t> keys(events);
+    for (uint64_t &key : keys)
+        key = popularity(random) * 0x9e3779b97f4a7c15ULL;
+
+    youtube::backend::TrendingIndex index;
+    BenchClock::time_point start = BenchClock::now();
+    for (const uint64_t key : keys)
+        index.record(key);
+    const double recordSeconds = elapsedSeconds(start);
+
+    // keys are rank * constant, so the true top 10 are the ten smallest ranks
+    size_t hits = 0;
+    for (const youtube::backend::TrendingIndex::Entry &entry : index.top(youtube::TrendingWindow::Day, 10))
+        hits += entry.key / 0x9e3779b97f4a7c15ULL < 10;
+    report.addThroughput("trending record", events, recordSeconds,
+                         {{"ns_per_event", recordSeconds * 1e9 / static_cast<double>(events)},
+                          {"memory_bytes", static_cast<double>(index.memoryUsage())},
+                          {"true_top10_found", static_cast<double>(hits)}});
+    const size_t queries = options.operations;
+    youtube::LatencyHistogram latency;
+    start = BenchClock::now();
+    for (size_t i = 0; i < queries; ++i) {
+        const BenchClock::time_point begin = BenchClock::now();
+        index.top(youtube::TrendingWindow::Hour, 10);
+        latency.record(elapsedNanos(begin));
+    }
+    report.addLatency("trending top 10", latency, elapsedSeconds(start));
+}
+
+/**
+ * Typeahead over many synthetic titles: build rate, memory per title, cost of a like and latency
+ * of every keystroke while typing titles out.
+ */
+void benchComplete(const BenchOptions &options, BenchReport &report) {
+    const size_t titles = options.videos * 500;
+    const size_t likes = options.operations * 50;
+    report.addParameter("titles", titles);
+    report.addParameter("likes", likes);
+    report.addParameter("zipf", options.zipf);
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+    const ZipfDistribution wordPopularity(20000, options.zipf);
+    auto makeTitle = [&] {
+        std::string title;
+        const size_t words = 2 + random.nextUInt64() % 4;
+        for (size_t i = 0; i < words; ++i) {
+            if (i)
+                title += ' ';
+            title += "w" + std::to_string(wordPopularity(random) * 7919 % 100000);
+        }
+        return title;
+    };
+
+    youtube::backend::CompletionIndex index;
+    std::vector<std::string> sample;
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < titles; ++i) {
+        const std::string title = makeTitle();
+        index.insert(static_cast<uint32_t>(i), title);
+        if (i % 1000 == 0)
+            sample.push_back(title);
+    }
+    const double buildSeconds = elapsedSeconds(start);
+    report.addThroughput("complete insert", titles, buildSeconds,
+                         {{"bytes_per_title", static_cast<double>(index.memoryUsage()) / static_cast<double>(titles)}});
+
+    const ZipfDistribution videoPopularity(titles, options.zipf);
+    std::vector<uint32_t> liked(likes);
+    for (uint32_t &item : liked)
+        item = static_cast<uint32_t>(videoPopularity(random));
+    start = BenchClock::now();
+    for (const uint32_t item : liked)
+        index.addScore(item);
+    report.addThroughput("complete like", likes, elapsedSeconds(start));
+
+    youtube::LatencyHistogram latency;
+    start = BenchClock::now();
+    for (const std::string &title : sample) {
+        for (size_t length = 1; length <= title.size(); ++length) {
+            const BenchClock::time_point begin = BenchClock::now();
+            index.complete(std::string_view(title).substr(0, length), 10);
+            latency.record(elapsedNanos(begin));
+        }
+    }
+    report.addLatency("complete keystroke", latency, elapsedSeconds(start));
+}
+
+size_t heapInUse() {
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+/**
+ * Memory per video of a storage holding many videos, measured as heap growth while adding them,
+ * with the share of every structure the storage accounts for; then getVideo and search over it.
+ * Overhead is what remains after the titles themselves and the completion and trending indexes.
+ */
+void benchCatalog(const BenchOptions &options, BenchReport &report) {
+    const size_t videos = options.videos * 500;
+    const size_t owners = 1000;
+    report.addParameter("videos", videos);
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+    const ZipfDistribution wordPopularity(20000, options.zipf);
+    auto makeTitle = [&] {
+        std::string title;
+        const size_t words = 2 + random.nextUInt64() % 4;
+        for (size_t i = 0; i < words; ++i) {
+            if (i)
+                title += ' ';
+            title += "w" + std::to_string(wordPopularity(random) * 7919 % 100000);
+        }
+        return title;
+    };
+
+    youtube::backend::DataStorage storage;
+    std::vector<std::string> sample;
+    size_t titleBytes = 0;
+    const size_t heapBefore = heapInUse();
+    const BenchClock::time_point start = BenchClock::now();
+    {
+        const auto lock = storage.writeLock();
+        std::vector<std::shared_ptr<youtube::backend::User>> users;
+        for (size_t i = 0; i < owners; ++i)
+            users.push_back(storage.createUser(userName(i), youtube::backend::PasswordHash()));
+        for (size_t i = 0; i < videos; ++i) {
+            const std::string title = makeTitle();
+            titleBytes += title.size();
+            const uint32_t index = storage.createVideo(users[i % owners], title, "");
+            if (i % 1000 == 0)
+                sample.push_back(storage.video(index)->id);
+        }
+    }
+    const double seconds = elapsedSeconds(start);
+    const auto perVideo = [videos](const double bytes) {
+        return bytes / static_cast<double>(videos);
+    };
+    const auto heap = static_cast<double>(heapInUse() - heapBefore);
+    std::vector<std::pair<std::string, double>> memory{{"heap_bytes_per_video", perVideo(heap)},
+                                                       {"title_bytes_per_video", perVideo(titleBytes)}};
+    double indexBytes = 0;
+    {
+        const auto lock = storage.readLock();
+        for (const auto &gauge : storage.gauges()) {
+            const std::string &name = gauge.first;
+            if (name.size() > 6 && name.compare(name.size() - 6, 6, "_bytes") == 0) {
+                memory.emplace_back(name + "_per_video", perVideo(gauge.second));
+                if (name == "completion_bytes" || name == "trending_bytes")
+                    indexBytes += gauge.second;
+            }
+        }
+    }
+    memory.emplace_back("overhead_bytes_per_video", perVideo(heap - indexBytes - titleBytes));
+    report.addThroughput("catalog build", videos, seconds, memory);
+
+    youtube::backend::BackendImpl backend(storage);
+    const size_t lookups = options.operations * 10;
+    BenchClock::time_point begin = BenchClock::now();
+    size_t checksum = 0;
+    for (size_t i = 0; i < lookups; ++i)
+        checksum += backend.getVideo(sample[random.nextUInt64() % sample.size()])->title.size();
+    report.addThroughput("catalog getVideo", lookups, elapsedSeconds(begin),
+                         {{"checksum", static_cast<double>(checksum)}});
+    const size_t searches = 20;
+    begin = BenchClock::now();
+    checksum = 0;
+    for (size_t i = 0; i < searches; ++i)
+        checksum += backend.searchVideos({"w" + std::to_string(wordPopularity(random) * 7919 % 100000)}).size();
+    report.addThroughput("catalog search", searches, elapsedSeconds(begin),
+                         {{"matches", static_cast<double>(checksum)}});
+}
+
+/**
+ * Readers walking every comment of a hot video while a writer likes and replies to them every 50 us,
+ * by reader thread count: through lock-free snapshots, through borrowed ones that leave the snapshot's
+ * reference count alone, and holding the storage read lock for the walk as readers of the live comment
+ * vectors had to. Reports walks per second and the writes that
+ * got through meanwhile.
+ */
+void benchComments(const BenchOptions &options, BenchReport &report) {
+    const size_t walks = options.operations * 5;
+    const size_t comments = 200;
+    const std::chrono::microseconds writeInterval(50);
+    report.addParameter("threads", options.threads);
+    report.addParameter("walks", walks);
+    report.addParameter("comments", comments);
+
+    youtube::backend::DataStorage storage;
+    std::shared_ptr<youtube::backend::User> owner;
+    {
+        const auto lock = storage.writeLock();
+        owner = storage.createUser("owner", youtube::backend::PasswordHash());
+    }
+    // every run gets a fresh video, so that all of them walk lists of the same size
+    auto makeVideo = [&] {
+        const auto lock = storage.writeLock();
+        const uint32_t video = storage.createVideo(owner, "hot", "");
+        for (size_t i = 0; i < comments; ++i)
+            storage.addComment(video, userName(i), "comment " + std::to_string(i));
+        return video;
+    };
+    auto walk = [](const youtube::CommentList &list) {
+        size_t likes = 0;
+        for (const youtube::CommentList::Element &comment : list) {
+            likes += comment->getLikes() + comment->content.size();
+            for (const youtube::CommentList::Element &reply : comment->getReplies())
+                likes += reply->getLikes();
+        }
+        return likes;
+    };
+
+    enum class Read {
+        Snapshot, Visit, ReadLock
+    };
+    const std::pair<const char *, Read> variants[] = {{"snapshot", Read::Snapshot}, {"visit", Read::Visit},
+                                                      {"read lock", Read::ReadLock}};
+    size_t fans = 0;
+    for (size_t threadCount = 1; threadCount <= options.threads; threadCount *= 2) {
+        for (const auto &variant : variants) {
+            const uint32_t video = makeVideo();
+            const std::shared_ptr<youtube::Video> view = storage.video(video);
+            std::atomic<bool> done{false};
+            std::atomic<size_t> writes{0};
+            std::thread writer([&] {
+                for (size_t i = 0; !done.load(std::memory_order_relaxed); ++i) {
+                    auto lock = storage.writeLock();
+                    // at most one reply per comment keeps the walks comparable
+                    if (i % 16 == 0 && i / 16 < comments)
+                        storage.addReply(video, i % comments, "writer", "reply");
+                    else
+                        storage.likeComment(video, i % comments, "fan" + std::to_string(fans++));
+                    writes.fetch_add(1, std::memory_order_relaxed);
+                    lock.unlock();
+                    std::this_thread::sleep_for(writeInterval);
+                }
+            });
+
+            std::atomic<size_t> checksum{0};
+            const BenchClock::time_point start = BenchClock::now();
+            std::vector<std::thread> readers;
+            for (size_t t = 0; t < threadCount; ++t) {
+                readers.emplace_back([&, t] {
+                    size_t sum = 0;
+                    for (size_t i = t; i < walks; i += threadCount) {
+                        if (variant.second == Read::ReadLock) {
+                            const auto lock = storage.readLock();
+                            sum += walk(*view->getComments());
+                        } else if (variant.second == Read::Visit) {
+                            view->visitComments([&](const youtube::CommentList &list) { sum += walk(list); });
+                        } else {
+                            sum += walk(*view->getComments());
+                        }
+                    }
+                    checksum += sum;
+                });
+            }
+            for (std::thread &reader : readers)
+                reader.join();
+            const double seconds = elapsedSeconds(start);
+            done = true;
+            writer.join();
+            report.addThroughput(std::string(variant.first) + " walks with " + std::to_string(threadCount) +
+                                 " readers", walks, seconds,
+                                 {{"writes_per_s", static_cast<double>(writes.load()) / seconds},
+                                  {"checksum", static_cast<double>(checksum.load())}});
+        }
+    }
+    report.addParameter("retired_pending", static_cast<double>(youtube::backend::EpochManager::instance().pending()));
+}
+
+/**
+ * getVideo throughput by replica count while one session keeps commenting and reading every
+ * comment straight back; a read that misses the session's own comment counts as a violation.
+ */
+void benchReplicas(const BenchOptions &options, BenchReport &report) {
+    const size_t reads = options.operations * 10;
+    report.addParameter("threads", options.threads);
+    report.addParameter("videos", options.videos);
+    report.addParameter("reads", reads);
+    report.addParameter("zipf", options.zipf);
+    const ZipfDistribution videoPopularity(options.videos, options.zipf);
+    const std::string content(options.contentSize, 'x');
+
+    for (const size_t replicaCount : {0, 1, 2, 4}) {
+        youtube::backend::DataStorage primary;
+        const auto log = std::make_shared<youtube::backend::ReplicationLog>();
+        std::vector<youtube::backend::ReadReplica> replicas;
+        for (size_t i = 0; i < replicaCount; ++i) {
+            const auto replica = std::make_shared<youtube::backend::Replica>(log);
+            replicas.push_back({replica->getBackend(), replica});
+        }
+        if (replicaCount)
+            primary.setReplicationLog(log);
+        const auto backend = std::make_shared<youtube::backend::Proxy>(
+                std::vector<std::shared_ptr<youtube::Backend>>{
+                        std::make_shared<youtube::backend::BackendImpl>(primary)}, replicas, log);
+
+        backend->registerUser("writer", "password");
+        const std::string token = backend->auth("writer", "password");
+        std::vector<std::string> ids;
+        for (size_t i = 0; i < options.videos; ++i) {
+            backend->addVideo(token, "video " + std::to_string(i), content);
+        }
+        for (const std::shared_ptr<youtube::Video> &video : backend->searchVideos(token, {"video"}))
+            ids.push_back(video->id);
+        for (const youtube::backend::ReadReplica &replica : replicas)
+            while (replica.replica->lag())
+                std::this_thread::yield();
+
+        std::atomic<bool> done{false};
+        size_t writes = 0;
+        size_t violations = 0;
+        std::thread writer([&] {
+            std::vector<size_t> expected(ids.size(), 0);
+            for (size_t i = 0; !done.load(std::memory_order_relaxed); ++i) {
+                const size_t video = i % ids.size();
+                backend->leaveComment(token, ids[video], "comment");
+                if (backend->getVideo(token, ids[video])->getComments()->size() < ++expected[video])
+                    ++violations;
+                ++writes;
+            }
+        });
+
+        std::vector<youtube::LatencyHistogram> perThread(options.threads);
+        const BenchClock::time_point start = BenchClock::now();
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < options.threads; ++t) {
+            readers.emplace_back([&, t] {
+                RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+                for (size_t i = t; i < reads; i += options.threads) {
+                    const BenchClock::time_point begin = BenchClock::now();
+                    backend->getVideo(ids[videoPopularity(random)]);
+                    perThread[t].record(elapsedNanos(begin));
+                }
+            });
+        }
+        for (std::thread &reader : readers)
+            reader.join();
+        const double seconds = elapsedSeconds(start);
+        done = true;
+        writer.join();
+
+        youtube::LatencyHistogram latency;
+        for (const youtube::LatencyHistogram &part : perThread)
+            latency.add(part);
+        const std::string suffix = " with " + std::to_string(replicaCount) + " replicas";
+        report.addLatency("getVideo" + suffix, latency, seconds);
+        report.addThroughput("leaveComment" + suffix, writes, seconds,
+                             {{"read_your_writes_violations", static_cast<double>(violations)}});
+    }
+}
+
+/**
+ * Video payloads with duplicates: uploads pick one of fewer distinct payloads by Zipf popularity,
+ * half of them text-like and half random bytes, as encoded video is. Compares keeping a copy per
+ * video with the deduplicating BlobStore, without and with compression: bytes kept, upload rate
+ * and rate of downloading every video back.
+ */
+void benchBlobs(const BenchOptions &options, BenchReport &report) {
+    const size_t uploads = options.videos;
+    const size_t distinct = std::max<size_t>(1, uploads / 4);
+    const size_t payloadSize = options.contentSize * 256;
+    report.addParameter("uploads", uploads);
+    report.addParameter("distinct_payloads", distinct);
+    report.addParameter("payload_size", payloadSize);
+    report.addParameter("zipf", options.zipf);
+    RandomSequenceGenerator &random = RandomSequenceGenerator::instance();
+    const ZipfDistribution wordPopularity(5000, options.zipf);
+    std::vector<std::string> payloads(distinct);
+    for (size_t i = 0; i < distinct; ++i) {
+        std::string &payload = payloads[i];
+        payload.reserve(payloadSize + 16);
+        while (payload.size() < payloadSize) {
+            if (i % 2)
+                payload += "w" + std::to_string(wordPopularity(random) * 7919 % 100000) + ' ';
+            else
+                payload += std::to_string(random.nextUInt64());
+        }
+        payload.resize(payloadSize);
+        if (i % 2 == 0)
+            for (char &c : payload)
+                c = static_cast<char>(c * 131 + (random.nextUInt64() & 0xff));
+    }
+    const ZipfDistribution payloadPopularity(distinct, options.zipf);
+    std::vector<size_t> picks(uploads);
+    for (size_t &pick : picks)
+        pick = payloadPopularity(random);
+    const double logicalBytes = static_cast<double>(uploads * payloadSize);
+    const double megabytes = logicalBytes / (1024 * 1024);
+
+    {
+        std::vector<std::string> copies;
+        BenchClock::time_point start = BenchClock::now();
+        for (const size_t pick : picks)
+            copies.push_back(payloads[pick]);
+        double seconds = elapsedSeconds(start);
+        report.addThroughput("copy per video upload", uploads, seconds,
+                             {{"MB_per_s", megabytes / seconds}, {"stored_bytes", logicalBytes}});
+        size_t checksum = 0;
+        start = BenchClock::now();
+        for (const std::string &copy : copies)
+            checksum += std::string(copy).size();
+        seconds = elapsedSeconds(start);
+        report.addThroughput("copy per video download", uploads, seconds,
+                             {{"MB_per_s", megabytes / seconds}, {"checksum", static_cast<double>(checksum)}});
+    }
+
+    const std::pair<const char *, bool> variants[] = {{"blob store", false}, {"blob store compressed", true}};
+    for (const auto &variant : variants) {
+        youtube::backend::BlobStore store(variant.second);
+        std::vector<youtube::backend::BlobStore::Handle> handles;
+        BenchClock::time_point start = BenchClock::now();
+        for (const size_t pick : picks)
+            handles.push_back(store.put(payloads[pick]));
+        double seconds = elapsedSeconds(start);
+        const auto stored = static_cast<double>(store.storedSize());
+        report.addThroughput(std::string(variant.first) + " upload", uploads, seconds,
+                             {{"MB_per_s", megabytes / seconds},
+                              {"stored_bytes", stored},
+                              {"saved_percent", 100 * (1 - stored / logicalBytes)},
+                              {"blobs", static_cast<double>(store.blobCount())}});
+        size_t checksum = 0;
+        start = BenchClock::now();
+        for (const youtube::backend::BlobStore::Handle handle : handles)
+            checksum += store.read(handle).size();
+        seconds = elapsedSeconds(start);
+        report.addThroughput(std::string(variant.first) + " download", uploads, seconds,
+                             {{"MB_per_s", megabytes / seconds}, {"checksum", static_cast<double>(checksum)}});
+    }
+}
+
+/**
+ * getVideo and downloadVideo through RpcServer over a Unix socket: every thread shares one
+ * RemoteBackend connection, so requests from different threads are pipelined on it.
+ */
+void benchRpc(const BenchOptions &options, BenchReport &report) {
+    const size_t calls = options.operations;
+    report.addParameter("threads", options.threads);
+    report.addParameter("calls", calls);
+    report.addParameter("content_size", options.contentSize);
+    const std::string path = "/tmp/youtube_bench_" + std::to_string(getpid()) + ".sock";
+    youtube::backend::RpcServer server(makeBackend(), path);
+    std::thread loop([&server] { server.run(); });
+    {
+        const auto remote = std::make_shared<youtube::client::RemoteBackend>(path);
+        remote->registerUser("rpc", "password");
+        const std::string token = remote->auth("rpc", "password");
+        const std::string content(options.contentSize, 'x');
+        remote->addVideo(token, "rpc video", content);
+        const std::string videoId = remote->searchVideos({"rpc"}).front()->id;
+        if (remote->downloadVideo(videoId) != content)
+            throw std::runtime_error("Exception: content changed on its way over rpc");
+
+        const std::pair<const char *, bool> variants[] = {{"getVideo over rpc", false},
+                                                          {"downloadVideo over rpc", true}};
+        for (const auto &variant : variants) {
+            std::vector<youtube::LatencyHistogram> perThread(options.threads);
+            const BenchClock::time_point start = BenchClock::now();
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < options.threads; ++t) {
+                threads.emplace_back([&, t] {
+                    for (size_t i = t; i < calls; i += options.threads) {
+                        const BenchClock::time_point begin = BenchClock::now();
+                        if (variant.second)
+                            remote->downloadVideo(videoId);
+                        else
+                            remote->getVideo(videoId);
+                        perThread[t].record(elapsedNanos(begin));
+                    }
+                });
+            }
+            for (std::thread &thread : threads)
+                thread.join();
+
+            const double seconds = elapsedSeconds(start);
+            youtube::LatencyHistogram latency;
+            for (const youtube::LatencyHistogram &part : perThread)
+                latency.add(part);
+            report.addLatency(variant.first, latency, seconds);
+        }
+    }
+    server.stop();
+    loop.join();
+}
+
+/**
+ * @return false unless the value is a plain non-negative integer that fits
+ */
+bool parseCount(const std::string &value, size_t &count) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    try {
+        count = std::stoull(value);
+    } catch (const std::out_of_range &) {
+        return false;
+    }
+    return true;
+}
+
+bool parseExponent(const std::string &value, double &exponent) {
+    size_t parsed = 0;
+    try {
+        exponent = std::stod(value, &parsed);
+    } catch (const std::logic_error &) {
+        return false;
+    }
+    return parsed == value.size() && std::isfinite(exponent) && exponent >= 0;
+}
+
+/**
+ * @return why the options cannot be run, or an empty string
+ */
+std::string validate(const BenchOptions &options) {
+    if (options.threads == 0)
+        return "--threads must be at least 1";
+    if (options.rounds == 0)
+        return "--rounds must be at least 1";
+    if (options.videos == 0)
+        return "--videos must be at least 1";
+    if (options.operations == 0)
+        return "--operations must be at least 1";
+    if (options.readPercent > 100)
+        return "--read-percent must be at most 100";
+    return std::string();
+}
+
+void printUsage() {
+    std::cerr << "usage: youtube_bench auth|blobs|catalog|comments|complete|graph|load|overhead|replicas|rpc|trending [--threads N] [--users N] [--rounds N]\n"
+                 "                     [--follows N] [--videos N] [--operations N] [--read-percent N] [--content-size N]\n"
+                 "                     [--zipf S] [--json FILE]" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    const std::string scenario = argc > 1 ? argv[1] : "load";
+    for (int i = 2; i < argc; i += 2) {
+        const std::string flag = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "missing value for " << flag << std::endl;
+            printUsage();
+            return 1;
+        }
+        const std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--threads")
+            valid = parseCount(value, options.threads);
+        else if (flag == "--users")
+            valid = parseCount(value, options.users);
+        else if (flag == "--rounds")
+            valid = parseCount(value, options.rounds);
+        else if (flag == "--follows")
+            valid = parseCount(value, options.follows);
+        else if (flag == "--videos")
+            valid = parseCount(value, options.videos);
+        else if (flag == "--operations")
+            valid = parseCount(value, options.operations);
+        else if (flag == "--read-percent")
+            valid = parseCount(value, options.readPercent);
+        else if (flag == "--content-size")
+            valid = parseCount(value, options.contentSize);
+        else if (flag == "--zipf")
+            valid = parseExponent(value, options.zipf);
+        else if (flag == "--json")
+            options.json = value;
+        else {
+            std::cerr << "unknown option " << flag << std::endl;
+            printUsage();
+            return 1;
+        }
+        if (!valid) {
+            std::cerr << "bad value for " << flag << ": " << value << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+    const std::string problem = validate(options);
+    if (!problem.empty()) {
+        std::cerr << problem << std::endl;
+        printUsage();
+        return 1;
+    }
+
+    const std::map<std::string, void (*)(const BenchOptions &, BenchReport &)> scenarios = {
+            {"auth",     benchAuth},
+            {"blobs",    benchBlobs},
+            {"catalog",  benchCatalog},
+            {"comments", benchComments},
+            {"complete", benchComplete},
+            {"graph",    benchGraph},
+            {"load",     benchLoad},
+            {"overhead", benchOverhead},
+            {"replicas", benchReplicas},
+            {"trending", benchTrending},
+            {"rpc",      benchRpc}
+    };
+    const auto found = scenarios.find(scenario);
+    if (found == scenarios.end()) {
+        printUsage();
+        return 1;
+    }
+
+    BenchReport report(scenario);
+    found->second(options, report);
+    report.print(std::cout);
+    if (!options.json.empty()) {
+        std::ofstream json(options.json);
+        report.writeJson(json);
+    }
+    return 0;
+}
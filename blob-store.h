@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "compression.h"
+
+namespace youtube {
+    namespace backend {
+        class CorruptBlobException : public std::runtime_error {
+        public:
+            CorruptBlobException() : std::runtime_error("Exception: stored content is corrupt") {}
+        };
+
+        /**
+         * Content-addressed storage for video payloads.
+         *
+         * Payloads are found by a 64-bit hash and confirmed by comparing bytes, so identical uploads
+         * are kept once and counted by reference. Payloads of at least compressionThreshold bytes are
+         * split into chunks of chunkSize bytes compressed independently with LzCodec; a chunk that does
+         * not shrink is kept as is. Any chunk decodes on its own, so readers can stream a payload
+         * without materializing it whole.
+         *
+         * Not synchronized: the owner serializes writers against readers.
+         */
+        class BlobStore {
+        public:
+            using Handle = uint32_t;
+
+            static constexpr size_t chunkSize = 64 * 1024;
+            static constexpr size_t compressionThreshold = 4 * 1024;
+
+        private:
+            struct Chunk {
+                uint32_t offset;
+                uint32_t storedSize;
+                uint32_t rawSize;
+                bool compressed;
+            };
+
+            struct Blob {
+                uint64_t hash = 0;
+                uint64_t size = 0;
+                uint32_t references = 0;
+                // without chunks, data is the payload itself
+                std::string data;
+                std::vector<Chunk> chunks;
+            };
+
+            const bool compression;
+            std::vector<Blob> blobs;
+            std::vector<Handle> freeHandles;
+            std::unordered_multimap<uint64_t, Handle> byHash;
+            uint64_t logicalBytes = 0;
+            uint64_t storedBytes = 0;
+            size_t references = 0;
+
+            static uint64_t rotate(const uint64_t value, const int bits) {
+                return (value << bits) | (value >> (64 - bits));
+            }
+
+            static uint64_t mix(uint64_t value) {
+                value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+                return value ^ (value >> 31);
+            }
+
+            void compress(Blob &blob, const std::string_view content) const {
+                std::string packed;
+                for (size_t offset = 0; offset < content.size(); offset += chunkSize) {
+                    const size_t rawSize = std::min(chunkSize, content.size() - offset);
+                    const size_t start = blob.data.size();
+                    packed.clear();
+                    LzCodec::compress(content.data() + offset, rawSize, packed);
+                    const bool compressed = packed.size() < rawSize;
+                    if (compressed)
+                        blob.data += packed;
+                    else
+                        blob.data.append(content.data() + offset, rawSize);
+                    blob.chunks.push_back(Chunk{static_cast<uint32_t>(start),
+                                                static_cast<uint32_t>(blob.data.size() - start),
+                                                static_cast<uint32_t>(rawSize), compressed});
+                }
+                blob.data.shrink_to_fit();
+            }
+
+            template<typename Visitor>
+            bool visit(const Blob &blob, Visitor &&visitor) const {
+                if (blob.chunks.empty())
+                    return visitor(std::string_view(blob.data));
+                std::string buffer;
+                for (const Chunk &chunk : blob.chunks) {
+                    const char *stored = blob.data.data() + chunk.offset;
+                    if (!chunk.compressed) {
+                        if (!visitor(std::string_view(stored, chunk.rawSize)))
+                            return false;
+                        continue;
+                    }
+                    buffer.resize(chunk.rawSize);
+                    if (!LzCodec::decompress(stored, chunk.storedSize, &buffer[0], chunk.rawSize))
+                        throw CorruptBlobException();
+                    if (!visitor(std::string_view(buffer)))
+                        return false;
+                }
+                return true;
+            }
+
+            bool contains(const Blob &blob, const std::string_view content) const {
+                if (blob.size != content.size())
+                    return false;
+                size_t position = 0;
+                return visit(blob, [&](const std::string_view piece) {
+                    const bool equal = std::memcmp(piece.data(), content.data() + position, piece.size()) == 0;
+                    position += piece.size();
+                    return equal;
+                });
+            }
+
+        public:
+            explicit BlobStore(const bool compression = true) : compression(compression) {}
+
+            static uint64_t hash(const std::string_view content) {
+                constexpr uint64_t multiplier = 0x9fb21c651e98df25ULL;
+                uint64_t result = content.size() * multiplier;
+                size_t position = 0;
+                for (; position + 8 <= content.size(); position += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, content.data() + position, sizeof(word));
+                    result = rotate(result ^ (word * multiplier), 29) * 0xc2b2ae3d27d4eb4fULL;
+                }
+                uint64_t tail = 0;
+                if (position < content.size())
+                    std::memcpy(&tail, content.data() + position, content.size() - position);
+                return mix(result ^ tail);
+            }
+
+            /**
+             * Stores the payload or takes another reference to an identical stored one.
+             * @return handle to pass to read and release
+             */
+            Handle put(const std::string_view content) {
+                const uint64_t key = hash(content);
+                logicalBytes += content.size();
+                ++references;
+                const auto range = byHash.equal_range(key);
+                for (auto it = range.first; it != range.second; ++it) {
+                    Blob &blob = blobs[it->second];
+                    if (contains(blob, content)) {
+                        ++blob.references;
+                        return it->second;
+                    }
+                }
+
+                Handle handle;
+                if (freeHandles.empty()) {
+                    handle = static_cast<Handle>(blobs.size());
+                    blobs.emplace_back();
+                } else {
+                    handle = freeHandles.back();
+                    freeHandles.pop_back();
+                }
+                Blob &blob = blobs[handle];
+                blob.hash = key;
+                blob.size = content.size();
+                blob.references = 1;
+                if (compression && content.size() >= compressionThreshold)
+                    compress(blob, content);
+                else
+                    blob.data.assign(content.data(), content.size());
+                storedBytes += blob.data.size();
+                byHash.emplace(key, handle);
+                return handle;
+            }
+
+            /**
+             * Drops one reference; the payload is freed with its last reference.
+             */
+            void release(const Handle handle) {
+                Blob &blob = blobs[handle];
+                logicalBytes -= blob.size;
+                --references;
+                if (--blob.references != 0)
+                    return;
+                const auto range = byHash.equal_range(blob.hash);
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (it->second == handle) {
+                        byHash.erase(it);
+                        break;
+                    }
+                }
+                storedBytes -= blob.data.size();
+                blob = Blob();
+                freeHandles.push_back(handle);
+            }
+
+            /**
+             * Passes the payload to the consumer in order, one piece per chunk.
+             */
+            template<typename Consumer>
+            void forEachChunk(const Handle handle, Consumer &&consumer) const {
+                visit(blobs[handle], [&](const std::string_view piece) {
+                    consumer(piece);
+                    return true;
+                });
+            }
+
+            std::string read(const Handle handle) const {
+                const Blob &blob = blobs[handle];
+                if (blob.chunks.empty())
+                    return blob.data;
+                std::string result(blob.size, '\0');
+                for (const Chunk &chunk : blob.chunks) {
+                    char *out = &result[0] + (&chunk - blob.chunks.data()) * chunkSize;
+                    const char *stored = blob.data.data() + chunk.offset;
+                    if (!chunk.compressed)
+                        std::memcpy(out, stored, chunk.rawSize);
+                    else if (!LzCodec::decompress(stored, chunk.storedSize, out, chunk.rawSize))
+                        throw CorruptBlobException();
+                }
+                return result;
+            }
+
+            uint64_t size(const Handle handle) const {
+                return blobs[handle].size;
+            }
+
+            /**
+             * @return bytes of all references as if every one held its own copy
+             */
+            uint64_t logicalSize() const {
+                return logicalBytes;
+            }
+
+            /**
+             * @return payload bytes actually stored, after deduplication and compression
+             */
+            uint64_t storedSize() const {
+                return storedBytes;
+            }
+
+            size_t blobCount() const {
+                return blobs.size() - freeHandles.size();
+            }
+
+            size_t referenceCount() const {
+                return references;
+            }
+
+            size_t memoryUsage() const {
+                size_t result = storedBytes + blobs.capacity() * sizeof(Blob) +
+                                freeHandles.capacity() * sizeof(Handle) +
+                                byHash.size() * (sizeof(uint64_t) + sizeof(Handle) + 2 * sizeof(void *)) +
+                                byHash.bucket_count() * sizeof(void *);
+                for (const Blob &blob : blobs)
+                    result += blob.chunks.capacity() * sizeof(Chunk);
+                return result;
+            }
+        };
+    }
+}
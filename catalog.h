@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "blob-store.h"
+#include "common-data.h"
+#include "epoch.h"
+#include "instrumentation.h"
+#include "util.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Comments of a video and who liked it or its comments; exists only for videos with any.
+         *
+         * Comments are published as versions: readers take the current snapshot without locks while
+         * the writer, serialized by the storage write lock, builds the next one next to it. Who liked
+         * what is only needed to reject repeated likes, so it stays on the writer side.
+         */
+        class VideoActivity {
+        private:
+            std::unordered_set<std::string> whoLiked;
+            std::vector<std::unordered_set<std::string>> commentLikers;
+            Versioned<CommentList> comments{std::make_shared<CommentList>()};
+
+        public:
+            std::shared_ptr<const CommentList> getComments() const {
+                return comments.load();
+            }
+
+            void visitComments(const std::function<void(const CommentList &)> &visitor) const {
+                comments.read(visitor);
+            }
+
+            /**
+             * The methods below are for the writer holding the storage write lock.
+             */
+            size_t commentCount() const {
+                return commentLikers.size();
+            }
+
+            /**
+             * @return false if the user had already liked the video
+             */
+            bool like(const std::string &userName) {
+                return whoLiked.insert(userName).second;
+            }
+
+            void addComment(std::shared_ptr<const Comment> comment) {
+                commentLikers.emplace_back();
+                comments.publish(std::make_shared<CommentList>(comments.latest().append(std::move(comment))));
+            }
+
+            void addReply(const size_t commentIndex, std::shared_ptr<const Comment> reply) {
+                const CommentList &latest = comments.latest();
+                comments.publish(std::make_shared<CommentList>(
+                        latest.replace(commentIndex, latest[commentIndex]->withReply(std::move(reply)))));
+            }
+
+            /**
+             * @return false if the user had already liked the comment
+             */
+            bool likeComment(const size_t commentIndex, const std::string &userName) {
+                if (!commentLikers[commentIndex].insert(userName).second)
+                    return false;
+                const CommentList &latest = comments.latest();
+                comments.publish(std::make_shared<CommentList>(
+                        latest.replace(commentIndex, latest[commentIndex]->withLike())));
+                return true;
+            }
+        };
+
+        /**
+         * The VideoActivity of every video that has one, by video index. Shared with the views, which may
+         * outlive the catalog and look up activity created after them without locks: each index has an
+         * atomic slot the writer fills once, in chunks allocated only where some video has activity, and
+         * the list of chunks is replaced as a whole when it grows. Activities live as long as the directory.
+         */
+        class ActivityDirectory {
+        private:
+            static constexpr size_t chunkSize = 4096;
+
+            using Chunk = std::array<std::atomic<VideoActivity *>, chunkSize>;
+
+            // null for chunks without any activity
+            Versioned<std::vector<Chunk *>> chunks{std::make_shared<std::vector<Chunk *>>()};
+            std::vector<std::unique_ptr<Chunk>> ownedChunks;
+            std::vector<std::unique_ptr<VideoActivity>> activities;
+
+        public:
+            /**
+             * @return the video's activity, or nullptr while it has none
+             */
+            const VideoActivity *find(const uint32_t index) const {
+                return chunks.read([index](const std::vector<Chunk *> &list) -> const VideoActivity * {
+                    const size_t chunk = index / chunkSize;
+                    if (chunk >= list.size() || !list[chunk])
+                        return nullptr;
+                    return (*list[chunk])[index % chunkSize].load(std::memory_order_acquire);
+                });
+            }
+
+            /**
+             * The video's activity for the writer, created on first use.
+             */
+            VideoActivity &obtain(const uint32_t index) {
+                const size_t chunk = index / chunkSize;
+                const std::vector<Chunk *> &list = chunks.latest();
+                if (chunk >= list.size() || !list[chunk]) {
+                    auto next = std::make_shared<std::vector<Chunk *>>(list);
+                    next->resize(std::max(next->size(), chunk + 1), nullptr);
+                    ownedChunks.push_back(std::make_unique<Chunk>());
+                    (*next)[chunk] = ownedChunks.back().get();
+                    chunks.publish(std::move(next));
+                }
+                std::atomic<VideoActivity *> &slot = (*chunks.latest()[chunk])[index % chunkSize];
+                VideoActivity *activity = slot.load(std::memory_order_relaxed);
+                if (!activity) {
+                    activities.push_back(std::make_unique<VideoActivity>());
+                    activity = activities.back().get();
+                    slot.store(activity, std::memory_order_release);
+                }
+                return *activity;
+            }
+
+            /**
+             * For the writer or holders of the storage lock.
+             */
+            size_t memoryUsage() const {
+                return ownedChunks.size() * sizeof(Chunk) + ownedChunks.capacity() * sizeof(void *) +
+                       chunks.latest().capacity() * sizeof(void *) +
+                       activities.size() * sizeof(VideoActivity) + activities.capacity() * sizeof(void *);
+            }
+        };
+
+        /**
+         * A catalog entry as handed out to readers, made on every read: id, title and likes as of the
+         * read, comments as of each getComments() call, including those of a video that had none when
+         * the view was made.
+         */
+        class CatalogVideo : public Video {
+        private:
+            const size_t likes;
+            const std::shared_ptr<const ActivityDirectory> directory;
+            const uint32_t index;
+
+            static const CommentList &none() {
+                static const CommentList empty;
+                return empty;
+            }
+
+        public:
+            CatalogVideo(std::string id, std::string title, const size_t likes,
+                         std::shared_ptr<const ActivityDirectory> directory, const uint32_t index)
+                    : Video(std::move(id), std::move(title)), likes(likes), directory(std::move(directory)),
+                      index(index) {}
+
+            std::shared_ptr<const CommentList> getComments() const override {
+                static const std::shared_ptr<const CommentList> empty = std::make_shared<CommentList>();
+                const VideoActivity *activity = directory->find(index);
+                return activity ? activity->getComments() : empty;
+            }
+
+            void visitComments(const std::function<void(const CommentList &)> &visitor) const override {
+                const VideoActivity *activity = directory->find(index);
+                if (activity)
+                    activity->visitComments(visitor);
+                else
+                    visitor(none());
+            }
+
+            const size_t getLikes() const override {
+                return likes;
+            }
+        };
+
+        /**
+         * All videos of one storage in columns indexed by a dense video index: keys, owners, like counts
+         * and content handles in parallel arrays, titles back to back in one arena, and an open
+         * addressing table from key to index. Comments and likers live in a VideoActivity, allocated
+         * only for videos that get any. Not synchronized apart from the activity directory shared with
+         * the views: the storage lock covers it.
+         */
+        class VideoCatalog {
+        public:
+            static constexpr uint32_t none = UINT32_MAX;
+
+        private:
+            std::vector<uint64_t> keys;
+            std::vector<uint32_t> owners;
+            std::vector<uint32_t> likes;
+            std::vector<BlobStore::Handle> contents;
+            // title i spans [titleEnds[i - 1], titleEnds[i]) of the arena
+            std::vector<uint64_t> titleEnds;
+            std::string titles;
+            // index + 1 of the video whose key hashes here, 0 for a free slot
+            std::vector<uint32_t> slots;
+            std::shared_ptr<ActivityDirectory> activities = std::make_shared<ActivityDirectory>();
+
+            static uint64_t hashOf(uint64_t key) {
+                key = (key ^ (key >> 33)) * 0xff51afd7ed558ccdULL;
+                return key ^ (key >> 33);
+            }
+
+            void place(const uint32_t index) {
+                const size_t mask = slots.size() - 1;
+                size_t slot = hashOf(keys[index]) & mask;
+                while (slots[slot])
+                    slot = (slot + 1) & mask;
+                slots[slot] = index + 1;
+            }
+
+            void grow() {
+                slots.assign(std::max<size_t>(slots.size() * 2, 16), 0);
+                for (uint32_t index = 0; index < keys.size(); ++index)
+                    place(index);
+            }
+
+        public:
+            /**
+             * @param key unique among the catalog's videos
+             * @return index of the new video, one past the previous one
+             */
+            uint32_t add(const uint64_t key, const uint32_t owner, const std::string_view title,
+                         const BlobStore::Handle content) {
+                const auto index = static_cast<uint32_t>(keys.size());
+                keys.push_back(key);
+                owners.push_back(owner);
+                likes.push_back(0);
+                contents.push_back(content);
+                titles.append(title.data(), title.size());
+                titleEnds.push_back(titles.size());
+                // at most 3/4 full
+                if (keys.size() * 4 > slots.size() * 3)
+                    grow();
+                else
+                    place(index);
+                return index;
+            }
+
+            /**
+             * @return index of the video, or none
+             */
+            uint32_t find(const uint64_t key) const {
+                if (slots.empty())
+                    return none;
+                const size_t mask = slots.size() - 1;
+                for (size_t slot = hashOf(key) & mask; slots[slot]; slot = (slot + 1) & mask)
+                    if (keys[slots[slot] - 1] == key)
+                        return slots[slot] - 1;
+                return none;
+            }
+
+            size_t size() const {
+                return keys.size();
+            }
+
+            uint64_t key(const uint32_t index) const {
+                return keys[index];
+            }
+
+            uint32_t owner(const uint32_t index) const {
+                return owners[index];
+            }
+
+            BlobStore::Handle content(const uint32_t index) const {
+                return contents[index];
+            }
+
+            std::string_view title(const uint32_t index) const {
+                const uint64_t begin = index ? titleEnds[index - 1] : 0;
+                return std::string_view(titles).substr(begin, titleEnds[index] - begin);
+            }
+
+            size_t commentCount(const uint32_t index) const {
+                const VideoActivity *activity = activities->find(index);
+                return activity ? activity->commentCount() : 0;
+            }
+
+            /**
+             * The video's activity for the writer, created on first use.
+             */
+            VideoActivity &activity(const uint32_t index) {
+                return activities->obtain(index);
+            }
+
+            /**
+             * @return false if the user had already liked the video
+             */
+            bool like(const uint32_t index, const std::string &userName) {
+                if (!activity(index).like(userName))
+                    return false;
+                ++likes[index];
+                return true;
+            }
+
+            std::shared_ptr<Video> view(const uint32_t index) const {
+                return std::make_shared<CatalogVideo>(IdCodec::encode(keys[index]), std::string(title(index)),
+                                                      likes[index], activities, index);
+            }
+
+            /**
+             * @return indexes of videos whose title holds any of the words, in upload order
+             */
+            std::vector<uint32_t> search(const std::vector<std::string> &request) const {
+                std::vector<uint32_t> result;
+                for (uint32_t index = 0; index < keys.size(); ++index) {
+                    const std::string_view info = title(index);
+                    for (const auto &req : request) {
+                        const size_t foundBegin = info.find(req);
+                        const size_t foundEnd = foundBegin + req.size();
+                        if (foundBegin == std::string::npos)
+                            continue;
+                        if (foundBegin != 0 && info[foundBegin - 1] != ' ')
+                            continue;
+                        if (foundEnd != info.size() && info[foundEnd] != ' ')
+                            continue;
+
+                        result.push_back(index);
+                        break;
+                    }
+                }
+                return result;
+            }
+
+            /**
+             * Bytes held by every structure, for the storage gauges.
+             */
+            MetricsRegistry::Gauges memoryUsage() const {
+                return {
+                        {"catalog_keys_bytes",     static_cast<double>(keys.capacity() * sizeof(uint64_t))},
+                        {"catalog_owners_bytes",   static_cast<double>(owners.capacity() * sizeof(uint32_t))},
+                        {"catalog_likes_bytes",    static_cast<double>(likes.capacity() * sizeof(uint32_t))},
+                        {"catalog_contents_bytes", static_cast<double>(contents.capacity() *
+                                                                       sizeof(BlobStore::Handle))},
+                        {"catalog_titles_bytes",   static_cast<double>(titles.capacity() +
+                                                                       titleEnds.capacity() * sizeof(uint64_t))},
+                        {"catalog_index_bytes",    static_cast<double>(slots.capacity() * sizeof(uint32_t))},
+                        {"catalog_activity_bytes", static_cast<double>(activities->memoryUsage())}
+                };
+            }
+        };
+    }
+}
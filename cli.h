@@ -1,58 +1,91 @@
 #pragma once
 
 #include <ostream>
+#include <sstream>
 #include <algorithm>
 #include <functional>
+#include <string_view>
+#include <unordered_map>
 
 #include "client.h"
 
 class YoutubeCLI {
 private:
-    using CLIAcceptor = std::function<bool(const std::vector<std::string> &)>;
-    using CLICommand = const std::vector<std::string>;
+    using CLICommand = const std::vector<std::string_view>;
+    using CLIAcceptor = std::function<bool(CLICommand &)>;
+
+    struct CLIHandler {
+        size_t minArgs;
+        size_t maxArgs;
+        CLIAcceptor executor;
+    };
 
     std::istream &input;
     std::ostream &output;
-    std::vector<CLIAcceptor> processingChain;
+    const bool interactive;
+    std::unordered_map<std::string, std::vector<CLIHandler>> commands;
+    std::string commandName;
     std::ostringstream helpString;
 
     youtube::client::YoutubeClient client;
 
 public:
-    YoutubeCLI(std::istream &input, std::ostream &output, youtube::client::YoutubeClient &&client)
-            : input(input), output(output), client(std::move(client)) {
+    /**
+     * @param interactive whether to print prompts and flush the output after every command;
+     * batch mode leaves buffering to the stream
+     */
+    YoutubeCLI(std::istream &input, std::ostream &output, youtube::client::YoutubeClient &&client,
+               const bool interactive = true)
+            : input(input), output(output), interactive(interactive), client(std::move(client)) {
         initProcessing();
     }
 
+    /**
+     * Enables the 'stats' command, printing whatever the reporter writes.
+     */
+    void setStatsReporter(std::function<void(std::ostream &)> reporter) {
+        acceptWithHelp("stats", 0, [this, reporter = std::move(reporter)](CLICommand &cmd) {
+            reporter(output);
+            return true;
+        }, "- show backend metrics");
+    }
+
     void handleNextCommand(CLICommand &command) {
         try {
-            for (CLIAcceptor &acceptor : processingChain)
-                if (acceptor(command))
-                    break;
+            if (!dispatch(command))
+                output << "Wrong command! Print 'help' for help.\n";
         } catch (const std::exception &exception) {
-            output << exception.what() << std::endl;
+            output << exception.what() << '\n';
         }
+        if (interactive)
+            output.flush();
     }
 
 private:
     void initProcessing() {
         acceptWithHelp("register", 2, [this](CLICommand &cmd) {
-            client.registerUser(cmd[1], cmd[2]);
-            output << "Success" << std::endl;
+            client.registerUser(std::string(cmd[1]), std::string(cmd[2]));
+            output << "Success\n";
             return true;
         }, "username password - register new user");
 
         acceptWithHelp("auth", 2, [this](CLICommand &cmd) {
-            client.auth(cmd[1], cmd[2]);
-            output << "Success" << std::endl;
+            client.auth(std::string(cmd[1]), std::string(cmd[2]));
+            output << "Success\n";
             return true;
         }, "username password - authorize");
 
+        acceptWithHelp("logout", 0, [this](CLICommand &cmd) {
+            client.logout();
+            output << "Success\n";
+            return true;
+        }, "- close current session");
+
         acceptWithHelp("upload-video", 1, [this](CLICommand &cmd) {
-            output << "Type your video here :)" << std::endl;
+            prompt("Type your video here :)");
             std::string video;
             std::getline(input, video);
-            client.uploadVideo(cmd[1], video);
+            client.uploadVideo(std::string(cmd[1]), video);
             return true;
         }, "title - upload new video");
 
@@ -62,80 +95,131 @@ private:
             for (const auto video : result) {
                 printVideo(video);
             }
-            output.flush();
             return true;
         }, "title - search videos");
 
         acceptWithHelp("download", 1, [this](CLICommand &cmd) {
-            std::string content = client.downloadVideo(cmd[1]);
-            output << content << std::endl;
+            std::string content = client.downloadVideo(std::string(cmd[1]));
+            output << content << '\n';
             return true;
         }, "videoId - download video content");
 
         acceptWithHelp("comment", 1, [this](CLICommand &cmd) {
-            output << "Type your comment here:" << std::endl;
+            prompt("Type your comment here:");
             std::string comment;
             std::getline(input, comment);
-            client.leaveComment(cmd[1], comment);
+            client.leaveComment(std::string(cmd[1]), comment);
             return true;
         }, "videoId - post a comment");
 
         acceptWithHelp("comment", 2, [this](CLICommand &cmd) {
-            output << "Type your comment here:" << std::endl;
+            prompt("Type your comment here:");
             std::string comment;
             std::getline(input, comment);
-            client.leaveComment(cmd[1], comment, std::stoull(cmd[2]) - 1);
+            client.leaveComment(std::string(cmd[1]), comment, std::stoull(std::string(cmd[2])) - 1);
             return true;
         }, "videoId commentNumber - reply to a comment");
 
         acceptWithHelp("show-comments", 1, [this](CLICommand &cmd) {
-            const std::shared_ptr<youtube::Video> video = client.getVideo(cmd[1]);
-            const std::vector<std::shared_ptr<youtube::Comment>> &comments = video->getComments();
-            printComments(comments);
-            output.flush();
+            const std::shared_ptr<youtube::Video> video = client.getVideo(std::string(cmd[1]));
+            const std::shared_ptr<const youtube::CommentList> comments = video->getComments();
+            printComments(*comments);
             return true;
         }, "videoId - list all comments");
 
         acceptWithHelp("like", 1, [this](CLICommand& cmd) {
-            client.likeVideo(cmd[1]);
+            client.likeVideo(std::string(cmd[1]));
             return true;
         }, "videoId - like video");
 
         acceptWithHelp("like", 2, [this](CLICommand& cmd) {
-            client.likeComment(cmd[1], std::stoull(cmd[2]) - 1);
+            client.likeComment(std::string(cmd[1]), std::stoull(std::string(cmd[2])) - 1);
             return true;
         }, "videoId commentIndex - like comment");
 
         acceptWithHelp("show-likes", 1, [this](CLICommand& cmd) {
-            const std::shared_ptr<youtube::Video> video = client.getVideo(cmd[1]);
-            output << video->getLikes() << std::endl;
+            const std::shared_ptr<youtube::Video> video = client.getVideo(std::string(cmd[1]));
+            output << video->getLikes() << '\n';
             return true;
         }, "videoId - show likes");
 
         acceptWithHelp("subscribe", 1, [this](CLICommand& cmd) {
-            client.subscribeFor(cmd[1]);
+            client.subscribeFor(std::string(cmd[1]));
             return true;
         }, "userName - follow user");
 
+        acceptWithHelp("unsubscribe", 1, [this](CLICommand& cmd) {
+            client.unsubscribeFrom(std::string(cmd[1]));
+            return true;
+        }, "userName - stop following user");
+
         acceptWithHelp("view-updates", 0, [this](CLICommand& cmd) {
             const std::vector<std::shared_ptr<youtube::Notification>> notifications = client.getAndReleaseNotifications();
             for (const std::shared_ptr<youtube::Notification> notification : notifications) {
+                if (notification->getUploads() > 1)
+                    output << "(" << notification->getUploads() << " new uploads, latest) ";
                 printVideo(notification->getObject());
             }
-            output.flush();
             return true;
         }, "- show new videos by users you follow");
 
+        acceptWithHelp("trending", 1, 2, [this](CLICommand &cmd) {
+            static const std::unordered_map<std::string_view, youtube::TrendingWindow> windows = {
+                    {"minute", youtube::TrendingWindow::Minute},
+                    {"hour",   youtube::TrendingWindow::Hour},
+                    {"day",    youtube::TrendingWindow::Day}
+            };
+            const auto window = windows.find(cmd[1]);
+            if (window == windows.end())
+                return false;
+            const size_t count = cmd.size() > 2 ? std::stoull(std::string(cmd[2])) : 10;
+            const std::vector<youtube::TrendingVideo> trending = client.getTrending(window->second, count);
+            for (size_t i = 0; i < trending.size(); ++i) {
+                output << i + 1 << ". (" << trending[i].events << " events) ";
+                printVideo(trending[i].video);
+            }
+            return true;
+        }, "minute|hour|day [count] - most liked and uploaded videos lately");
+
+        acceptWithHelp("complete", 1, 1000, [this](CLICommand &cmd) {
+            std::string prefix(cmd[1]);
+            for (size_t i = 2; i < cmd.size(); ++i)
+                prefix.append(" ").append(cmd[i]);
+            // the local backend returns at most 8 of each kind, see Backend::complete
+            const youtube::Completions completions = client.complete(prefix, 8);
+            for (const std::shared_ptr<youtube::Video> &video : completions.videos)
+                printVideo(video);
+            for (const std::string &name : completions.userNames)
+                output << "@" << name << '\n';
+            return true;
+        }, "prefix - suggest video titles and user names");
+
         acceptWithHelp("help", 0, [this](CLICommand &cmd) {
             output << helpString.str();
-            output.flush();
             return true;
         }, "- prints help");
 
-        processingChain.emplace_back([this](CLICommand &cmd) {
-            output << "Wrong command! Print 'help' for help." << std::endl;
-            return true;
-        });
+    }
+
+    bool dispatch(CLICommand &command) {
+        if (command.empty())
+            return false;
+        commandName.assign(command[0]);
+        std::transform(commandName.begin(), commandName.end(), commandName.begin(), ::tolower);
+
+        const auto found = commands.find(commandName);
+        if (found == commands.end())
+            return false;
+        const size_t numArgs = command.size() - 1;
+        for (const CLIHandler &handler : found->second)
+            if (handler.minArgs <= numArgs && numArgs <= handler.maxArgs)
+                return handler.executor(command);
+        return false;
+    }
+
+    void prompt(const char *text) {
+        if (interactive)
+            output << text << std::endl;
     }
 
 
@@ -156,26 +240,14 @@ private:
 
     void accept(std::string &&firstLexeme, int minArgs, int maxArgs, CLIAcceptor &&executor) {
         std::transform(firstLexeme.begin(), firstLexeme.end(), firstLexeme.begin(), ::tolower);
-        processingChain.emplace_back(
-                [minArgs, maxArgs, firstLexeme, executor = std::move(executor)](CLICommand &cmd) {
-                    if (cmd.size() - 1 < minArgs || cmd.size() - 1 > maxArgs)
-                        return false;
-
-                    std::string first = cmd[0];
-                    std::transform(first.begin(), first.end(), first.begin(), ::tolower);
-
-                    if (first != firstLexeme)
-                        return false;
-
-                    return executor(cmd);
-                }
-        );
+        commands[firstLexeme].push_back(CLIHandler{static_cast<size_t>(minArgs), static_cast<size_t>(maxArgs),
+                                                   std::move(executor)});
     }
 
-    void printComments(const std::vector<std::shared_ptr<youtube::Comment>>& comments, const std::string& shift="") const {
+    void printComments(const youtube::CommentList& comments, const std::string& shift="") const {
         bool first = true;
         for (size_t i = 0; i < comments.size(); ++i) {
-            const std::shared_ptr<youtube::Comment> comment = comments[i];
+            const youtube::CommentList::Element &comment = comments[i];
             if (!first) {
                 output << shift << "----------------\n";
             }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <utility>
 
 #include "common-data.h"
@@ -8,8 +9,14 @@ namespace youtube {
     namespace client {
         class YoutubeClient {
         private:
+            // notifications arrive on the threads of other clients' requests
+            struct ReceivedNotifications {
+                std::mutex mutex;
+                std::vector<std::shared_ptr<Notification>> notifications;
+            };
+
             const std::shared_ptr<Backend> backend;
-            std::vector<std::shared_ptr<Notification>> receivedNotifications;
+            std::shared_ptr<ReceivedNotifications> received = std::make_shared<ReceivedNotifications>();
             std::shared_ptr<ClientCallback> callback;
             std::string authToken;
 
@@ -21,22 +28,29 @@ namespace youtube {
             void auth(const std::string &name, const std::string &password) {
                 authToken = backend->auth(name, password);
                 backend->setClientCallback(authToken, callback = std::make_shared<ClientCallback>(
-                        [this](const std::shared_ptr<Notification> notification) {
-                            receivedNotifications.push_back(notification);
+                        [received = received](const std::shared_ptr<Notification> notification) {
+                            std::lock_guard<std::mutex> lock(received->mutex);
+                            received->notifications.push_back(notification);
                         }
                 ));
             }
 
+            void logout() {
+                backend->logout(authToken);
+                authToken.clear();
+                callback.reset();
+            }
+
             void registerUser(const std::string &name, const std::string &password) {
                 backend->registerUser(name, password);
             }
 
             const std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) {
-                return backend->searchVideos(request);
+                return backend->searchVideos(authToken, request);
             }
 
             const std::shared_ptr<Video> getVideo(const std::string &id) {
-                return backend->getVideo(id);
+                return backend->getVideo(authToken, id);
             }
 
             void uploadVideo(const std::string &name, const std::string &content) {
@@ -44,7 +58,7 @@ namespace youtube {
             }
 
             const std::string downloadVideo(const std::string &id) {
-                return backend->downloadVideo(id);
+                return backend->downloadVideo(authToken, id);
             }
 
             void leaveComment(const std::string &videoId, const std::string &comment) {
@@ -67,11 +81,24 @@ namespace youtube {
                 backend->subscribeFor(authToken, userName);
             }
 
+            void unsubscribeFrom(const std::string& userName) {
+                backend->unsubscribeFrom(authToken, userName);
+            }
+
+            const std::vector<TrendingVideo> getTrending(const TrendingWindow window, const size_t count) {
+                return backend->getTrending(window, count);
+            }
+
+            const Completions complete(const std::string &prefix, const size_t count) {
+                return backend->complete(prefix, count);
+            }
+
             const std::vector<std::shared_ptr<Notification>> getAndReleaseNotifications() {
                 backend->releasePendingNotifications(authToken);
 
                 std::vector<std::shared_ptr<Notification>> result;
-                result.swap(receivedNotifications);
+                std::lock_guard<std::mutex> lock(received->mutex);
+                result.swap(received->notifications);
                 return result;
             }
         };
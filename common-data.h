@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <utility>
 #include <vector>
 #include <map>
@@ -19,30 +22,137 @@ namespace youtube {
         virtual const size_t getLikes() const = 0;
     };
 
-    class Video;
-
     class Comment;
 
+    /**
+     * Immutable list of comments. Copies share storage: the elements sit in fixed-size chunks, and
+     * appending or replacing an element copies only its chunk and the chunk directory.
+     */
+    class CommentList {
+    public:
+        using Element = std::shared_ptr<const Comment>;
+
+        class Iterator {
+        private:
+            const CommentList *list;
+            size_t position;
+
+        public:
+            Iterator(const CommentList *list, const size_t position) : list(list), position(position) {}
+
+            const Element &operator*() const {
+                return (*list)[position];
+            }
+
+            Iterator &operator++() {
+                ++position;
+                return *this;
+            }
+
+            bool operator!=(const Iterator &other) const {
+                return position != other.position;
+            }
+        };
+
+    private:
+        static constexpr size_t chunkSize = 32;
+
+        using Chunk = std::vector<Element>;
+
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        size_t count = 0;
+
+    public:
+        CommentList() = default;
+
+        explicit CommentList(std::vector<Element> elements) : count(elements.size()) {
+            for (size_t begin = 0; begin < elements.size(); begin += chunkSize) {
+                const size_t end = std::min(elements.size(), begin + chunkSize);
+                chunks.push_back(std::make_shared<Chunk>(std::make_move_iterator(elements.begin() + begin),
+                                                         std::make_move_iterator(elements.begin() + end)));
+            }
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        const Element &operator[](const size_t index) const {
+            return (*chunks[index / chunkSize])[index % chunkSize];
+        }
+
+        Iterator begin() const {
+            return Iterator(this, 0);
+        }
+
+        Iterator end() const {
+            return Iterator(this, count);
+        }
+
+        CommentList append(Element element) const {
+            CommentList result(*this);
+            std::shared_ptr<Chunk> chunk;
+            if (count % chunkSize == 0) {
+                chunk = std::make_shared<Chunk>();
+                chunk->reserve(chunkSize);
+                result.chunks.emplace_back();
+            } else {
+                chunk = std::make_shared<Chunk>(*chunks.back());
+            }
+            chunk->push_back(std::move(element));
+            result.chunks.back() = std::move(chunk);
+            ++result.count;
+            return result;
+        }
+
+        CommentList replace(const size_t index, Element element) const {
+            CommentList result(*this);
+            auto chunk = std::make_shared<Chunk>(*chunks[index / chunkSize]);
+            (*chunk)[index % chunkSize] = std::move(element);
+            result.chunks[index / chunkSize] = std::move(chunk);
+            return result;
+        }
+    };
 
+    /**
+     * A comment as of one moment; liking or replying to it makes a new version.
+     */
     class Comment : virtual public Likeable {
-    protected:
-        std::vector<std::shared_ptr<Comment>> replies;
+    private:
+        const size_t likes;
+        const CommentList replies;
+
     public:
         const std::string userName;
         const std::string content;
 
-        Comment(std::string userName, std::string content)
-                : userName(std::move(userName)), content(std::move(content)) {}
+        Comment(std::string userName, std::string content, const size_t likes = 0,
+                CommentList replies = CommentList())
+                : likes(likes), replies(std::move(replies)),
+                  userName(std::move(userName)), content(std::move(content)) {}
 
-        virtual const std::vector<std::shared_ptr<Comment>> &getReplies() const {
+        const CommentList &getReplies() const {
             return replies;
         }
+
+        const size_t getLikes() const override {
+            return likes;
+        }
+
+        std::shared_ptr<const Comment> withReply(std::shared_ptr<const Comment> reply) const {
+            return std::make_shared<Comment>(userName, content, likes, replies.append(std::move(reply)));
+        }
+
+        std::shared_ptr<const Comment> withLike() const {
+            return std::make_shared<Comment>(userName, content, likes + 1, replies);
+        }
     };
 
     class Video : virtual public Likeable {
-    protected:
-        std::vector<std::shared_ptr<Comment>> comments;
-
     public:
         const std::string id;
         const std::string title;
@@ -50,8 +160,18 @@ namespace youtube {
         explicit Video(std::string id, std::string title)
                 : id(std::move(id)), title(std::move(title)) {}
 
-        const std::vector<std::shared_ptr<Comment>> &getComments() {
-            return comments;
+        /**
+         * @return the comments at the time of the call; the snapshot never changes, later comments
+         * and likes go to newer ones
+         */
+        virtual std::shared_ptr<const CommentList> getComments() const = 0;
+
+        /**
+         * Passes the current comments to the visitor without taking a reference to them, which is
+         * cheaper for a one-off walk; the list must not be kept past the call.
+         */
+        virtual void visitComments(const std::function<void(const CommentList &)> &visitor) const {
+            visitor(*getComments());
         }
 
         virtual const size_t getLikes() const = 0;
@@ -62,22 +182,48 @@ namespace youtube {
     class Notification {
     private:
         const std::shared_ptr<Video> video;
+        const size_t uploads;
 
     public:
-        Notification(std::shared_ptr<Video> video) : video(std::move(video)) {}
+        Notification(std::shared_ptr<Video> video, const size_t uploads = 1)
+                : video(std::move(video)), uploads(uploads) {}
 
         const std::shared_ptr<Video> getObject() const {
             return video;
         }
+
+        // number of uploads by the same author this notification stands for
+        const size_t getUploads() const {
+            return uploads;
+        }
     };
 
 
     using ClientCallback = std::function<void(const std::shared_ptr<Notification>)>;
 
+    enum class TrendingWindow {
+        Minute,
+        Hour,
+        Day
+    };
+
+    struct Completions {
+        std::vector<std::shared_ptr<Video>> videos;
+        std::vector<std::string> userNames;
+    };
+
+    struct TrendingVideo {
+        std::shared_ptr<Video> video;
+        // estimated uploads and new likes within the window
+        size_t events;
+    };
+
     class Backend {
     public:
         virtual const std::string auth(const std::string &name, const std::string &password) = 0;
 
+        virtual void logout(const std::string &authToken) = 0;
+
         virtual const std::string downloadVideo(const std::string &id) = 0;
 
         virtual void registerUser(const std::string &name, const std::string &password) = 0;
@@ -104,6 +250,35 @@ namespace youtube {
 
         virtual void subscribeFor(const std::string &authToken, const std::string &userName) = 0;
 
+        virtual void unsubscribeFrom(const std::string &authToken, const std::string &userName) = 0;
+
         virtual void releasePendingNotifications(const std::string &authToken) = 0;
+
+        virtual const std::vector<TrendingVideo> getTrending(TrendingWindow window, size_t count) = 0;
+
+        /**
+         * Typeahead: videos whose title and users whose name start with the prefix, most liked first.
+         * Backends may cap the number of each kind below count; the local one keeps 8 per prefix.
+         */
+        virtual const Completions complete(const std::string &prefix, size_t count) = 0;
+
+        /**
+         * Reads issued on behalf of a session. Backends that serve reads from replicas use the token
+         * to let the session see its own writes; the rest simply ignore it.
+         */
+        virtual const std::string downloadVideo(const std::string &/*authToken*/, const std::string &id) {
+            return downloadVideo(id);
+        }
+
+        virtual const std::vector<std::shared_ptr<Video>>
+        searchVideos(const std::string &/*authToken*/, const std::vector<std::string> &request) {
+            return searchVideos(request);
+        }
+
+        virtual const std::shared_ptr<Video> getVideo(const std::string &/*authToken*/, const std::string &id) {
+            return getVideo(id);
+        }
+
+        virtual ~Backend() = default;
     };
 }
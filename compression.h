@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Byte-oriented LZ77 codec in the style of LZ4: greedy matching through a small hash table of
+         * 4-byte sequences, no entropy coding, so both directions run at memory speed. Each call
+         * handles one self-contained block.
+         *
+         * A block is a series of sequences [token][literal length+][literals][offset u16][match length+];
+         * the token holds 4 bits of literal length and 4 bits of match length - 4, extended with 255-valued
+         * bytes. The last sequence stops after its literals.
+         */
+        class LzCodec {
+        private:
+            static constexpr size_t minMatch = 4;
+            static constexpr int hashBits = 12;
+            static constexpr size_t maxOffset = 65535;
+            static constexpr size_t wildCopy = 8;
+
+            static uint32_t read32(const uint8_t *p) {
+                uint32_t value;
+                std::memcpy(&value, p, sizeof(value));
+                return value;
+            }
+
+            static size_t hashOf(const uint32_t sequence) {
+                return (sequence * 2654435761u) >> (32 - hashBits);
+            }
+
+            static void writeLength(std::string &out, size_t length) {
+                while (length >= 255) {
+                    out.push_back(static_cast<char>(255));
+                    length -= 255;
+                }
+                out.push_back(static_cast<char>(length));
+            }
+
+            static void writeSequence(std::string &out, const uint8_t *literals, const size_t literalLength,
+                                      const size_t offset, const size_t matchLength) {
+                const size_t matchCode = matchLength ? matchLength - minMatch : 0;
+                out.push_back(static_cast<char>((std::min<size_t>(literalLength, 15) << 4) |
+                                                std::min<size_t>(matchCode, 15)));
+                if (literalLength >= 15)
+                    writeLength(out, literalLength - 15);
+                out.append(reinterpret_cast<const char *>(literals), literalLength);
+                if (!matchLength)
+                    return;
+                out.push_back(static_cast<char>(offset));
+                out.push_back(static_cast<char>(offset >> 8));
+                if (matchCode >= 15)
+                    writeLength(out, matchCode - 15);
+            }
+
+            /**
+             * Copies length bytes in whole words, writing up to wildCopy bytes past the end; the caller
+             * guarantees room for them and, for overlapping copies, source and target wildCopy bytes apart.
+             */
+            static void copyWords(uint8_t *target, const uint8_t *source, const size_t length) {
+                uint8_t *const end = target + length;
+                do {
+                    std::memcpy(target, source, wildCopy);
+                    target += wildCopy;
+                    source += wildCopy;
+                } while (target < end);
+            }
+
+            static bool readLength(const uint8_t *&in, const uint8_t *end, size_t &length) {
+                uint8_t byte;
+                do {
+                    if (in == end)
+                        return false;
+                    byte = *in++;
+                    length += byte;
+                } while (byte == 255);
+                return true;
+            }
+
+        public:
+            /**
+             * Appends the compressed block to out.
+             */
+            static void compress(const char *data, const size_t size, std::string &out) {
+                const auto *in = reinterpret_cast<const uint8_t *>(data);
+                // positions + 1, so that zero marks an empty slot
+                std::array<uint32_t, size_t{1} << hashBits> table{};
+                size_t anchor = 0;
+                size_t position = 0;
+                size_t misses = 0;
+                while (position + minMatch <= size) {
+                    const uint32_t sequence = read32(in + position);
+                    uint32_t &slot = table[hashOf(sequence)];
+                    const size_t candidate = slot;
+                    slot = static_cast<uint32_t>(position + 1);
+                    if (candidate == 0 || position - (candidate - 1) > maxOffset ||
+                        read32(in + candidate - 1) != sequence) {
+                        // skip faster through data that does not compress
+                        position += 1 + (misses++ >> 6);
+                        continue;
+                    }
+                    misses = 0;
+                    const size_t match = candidate - 1;
+                    size_t length = minMatch;
+                    while (position + length < size && in[match + length] == in[position + length])
+                        ++length;
+                    writeSequence(out, in + anchor, position - anchor, position - match, length);
+                    position += length;
+                    anchor = position;
+                }
+                writeSequence(out, in + anchor, size - anchor, 0, 0);
+            }
+
+            /**
+             * @param out buffer of exactly the original size
+             * @return false if the block is malformed or does not decode to exactly outSize bytes
+             */
+            static bool decompress(const char *data, const size_t size, char *out, const size_t outSize) {
+                const auto *in = reinterpret_cast<const uint8_t *>(data);
+                const uint8_t *const end = in + size;
+                auto *op = reinterpret_cast<uint8_t *>(out);
+                const uint8_t *const outEnd = op + outSize;
+                while (in < end) {
+                    const uint8_t token = *in++;
+                    size_t literalLength = token >> 4;
+                    if (literalLength == 15 && !readLength(in, end, literalLength))
+                        return false;
+                    if (static_cast<size_t>(end - in) < literalLength ||
+                        static_cast<size_t>(outEnd - op) < literalLength)
+                        return false;
+                    if (static_cast<size_t>(end - in) >= literalLength + wildCopy &&
+                        static_cast<size_t>(outEnd - op) >= literalLength + wildCopy)
+                        copyWords(op, in, literalLength);
+                    else
+                        std::memcpy(op, in, literalLength);
+                    in += literalLength;
+                    op += literalLength;
+                    if (in == end)
+                        break;
+
+                    if (end - in < 2)
+                        return false;
+                    const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+                    in += 2;
+                    size_t matchLength = token & 15;
+                    if (matchLength == 15 && !readLength(in, end, matchLength))
+                        return false;
+                    matchLength += minMatch;
+                    if (offset == 0 || offset > static_cast<size_t>(op - reinterpret_cast<uint8_t *>(out)) ||
+                        static_cast<size_t>(outEnd - op) < matchLength)
+                        return false;
+                    const uint8_t *match = op - offset;
+                    if (offset >= wildCopy && static_cast<size_t>(outEnd - op) >= matchLength + wildCopy) {
+                        copyWords(op, match, matchLength);
+                        op += matchLength;
+                    } else if (offset >= matchLength) {
+                        std::memcpy(op, match, matchLength);
+                        op += matchLength;
+                    } else {
+                        // overlapping copy repeats the last offset bytes
+                        for (size_t i = 0; i < matchLength; ++i)
+                            *op++ = *match++;
+                    }
+                }
+                return op == outEnd;
+            }
+        };
+    }
+}
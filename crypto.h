@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Incremental SHA-256 (FIPS 180-4).
+         */
+        class Sha256 {
+        public:
+            using Digest = std::array<uint8_t, 32>;
+            static constexpr size_t blockSize = 64;
+
+        private:
+            std::array<uint32_t, 8> state{};
+            std::array<uint8_t, blockSize> buffer{};
+            size_t buffered = 0;
+            uint64_t totalBytes = 0;
+
+            static uint32_t rotr(const uint32_t x, const int n) {
+                return (x >> n) | (x << (32 - n));
+            }
+
+            void compress(const uint8_t *block) {
+                static constexpr uint32_t k[64] = {
+                        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+                };
+
+                uint32_t w[64];
+                for (int i = 0; i < 16; ++i) {
+                    w[i] = (static_cast<uint32_t>(block[4 * i]) << 24) | (static_cast<uint32_t>(block[4 * i + 1]) << 16)
+                           | (static_cast<uint32_t>(block[4 * i + 2]) << 8) | static_cast<uint32_t>(block[4 * i + 3]);
+                }
+                for (int i = 16; i < 64; ++i) {
+                    const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+                for (int i = 0; i < 64; ++i) {
+                    const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                    const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+                state[5] += f;
+                state[6] += g;
+                state[7] += h;
+            }
+
+        public:
+            Sha256() {
+                state = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+            }
+
+            Sha256 &update(const void *data, size_t size) {
+                const auto *bytes = static_cast<const uint8_t *>(data);
+                totalBytes += size;
+                if (buffered != 0) {
+                    const size_t take = std::min(size, blockSize - buffered);
+                    std::memcpy(buffer.data() + buffered, bytes, take);
+                    buffered += take;
+                    bytes += take;
+                    size -= take;
+                    if (buffered < blockSize)
+                        return *this;
+                    compress(buffer.data());
+                    buffered = 0;
+                }
+                for (; size >= blockSize; bytes += blockSize, size -= blockSize)
+                    compress(bytes);
+                std::memcpy(buffer.data(), bytes, size);
+                buffered = size;
+                return *this;
+            }
+
+            Sha256 &update(const std::string &data) {
+                return update(data.data(), data.size());
+            }
+
+            Digest finish() {
+                const uint64_t totalBits = totalBytes * 8;
+                const uint8_t padding = 0x80;
+                update(&padding, 1);
+                const uint8_t zero = 0;
+                while (buffered != blockSize - 8)
+                    update(&zero, 1);
+                uint8_t length[8];
+                for (int i = 0; i < 8; ++i)
+                    length[i] = static_cast<uint8_t>(totalBits >> (56 - 8 * i));
+                update(length, 8);
+
+                Digest digest;
+                for (int i = 0; i < 8; ++i) {
+                    digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+                    digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+                    digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+                    digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+                }
+                return digest;
+            }
+        };
+
+        /**
+         * HMAC-SHA256 with the key schedule computed once, so repeated MACs under the same key
+         * (as in PBKDF2) cost two compressions per short message.
+         */
+        class HmacSha256 {
+        private:
+            Sha256 inner;
+            Sha256 outer;
+
+        public:
+            explicit HmacSha256(const std::string &key) {
+                std::array<uint8_t, Sha256::blockSize> block{};
+                if (key.size() > Sha256::blockSize) {
+                    const Sha256::Digest hashed = Sha256().update(key).finish();
+                    std::memcpy(block.data(), hashed.data(), hashed.size());
+                } else {
+                    std::memcpy(block.data(), key.data(), key.size());
+                }
+                std::array<uint8_t, Sha256::blockSize> pad{};
+                for (size_t i = 0; i < block.size(); ++i)
+                    pad[i] = block[i] ^ 0x36;
+                inner.update(pad.data(), pad.size());
+                for (size_t i = 0; i < block.size(); ++i)
+                    pad[i] = block[i] ^ 0x5c;
+                outer.update(pad.data(), pad.size());
+            }
+
+            Sha256::Digest mac(const void *data, const size_t size) const {
+                Sha256 innerHash = inner;
+                const Sha256::Digest innerDigest = innerHash.update(data, size).finish();
+                Sha256 outerHash = outer;
+                return outerHash.update(innerDigest.data(), innerDigest.size()).finish();
+            }
+        };
+
+        /**
+         * PBKDF2-HMAC-SHA256 (RFC 8018) producing a single 32-byte block.
+         */
+        inline Sha256::Digest pbkdf2Sha256(const std::string &password, const void *salt, const size_t saltSize,
+                                           const uint32_t iterations) {
+            const HmacSha256 hmac(password);
+            std::string first(static_cast<const char *>(salt), saltSize);
+            first.append("\x00\x00\x00\x01", 4);
+            Sha256::Digest u = hmac.mac(first.data(), first.size());
+            Sha256::Digest result = u;
+            for (uint32_t i = 1; i < iterations; ++i) {
+                u = hmac.mac(u.data(), u.size());
+                for (size_t j = 0; j < result.size(); ++j)
+                    result[j] ^= u[j];
+            }
+            return result;
+        }
+
+        /**
+         * Comparison whose running time does not depend on where the digests differ.
+         */
+        inline bool constantTimeEquals(const Sha256::Digest &a, const Sha256::Digest &b) {
+            uint8_t difference = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                difference |= static_cast<uint8_t>(a[i] ^ b[i]);
+            return difference == 0;
+        }
+    }
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Epoch-based reclamation for objects that lock-free readers may still be looking at.
+         *
+         * A reader announces the global epoch in its own slot for the duration of an EpochGuard and
+         * never blocks. Writers retire unlinked objects tagged with the epoch of their removal. The
+         * epoch only advances once every active reader has announced the current one, so an object
+         * retired in epoch e is unreachable by any reader when the epoch reaches e + 2 and is destroyed
+         * then. Retiring is a short critical section among writers only.
+         */
+        class EpochManager {
+        public:
+            static constexpr size_t maxThreads = 256;
+
+        private:
+            static constexpr size_t none = SIZE_MAX;
+            // retired objects waiting before a reclamation attempt
+            static constexpr size_t reclaimBatch = 64;
+
+            struct alignas(64) Slot {
+                // (epoch << 1) | 1 while the thread reads, 0 otherwise
+                std::atomic<uint64_t> state{0};
+                std::atomic<bool> claimed{false};
+            };
+
+            struct Retired {
+                uint64_t epoch;
+                void *object;
+                void (*destroy)(void *);
+            };
+
+            struct ThreadState {
+                size_t slot = none;
+                size_t depth = 0;
+
+                ~ThreadState() {
+                    if (slot != none)
+                        EpochManager::instance().slots[slot].claimed.store(false, std::memory_order_release);
+                }
+            };
+
+            std::array<Slot, maxThreads> slots;
+            std::atomic<size_t> slotLimit{0};
+            std::atomic<uint64_t> epoch{1};
+            std::mutex mutex;
+            std::vector<Retired> retired;
+
+            EpochManager() = default;
+
+            static ThreadState &threadState() {
+                thread_local ThreadState state;
+                return state;
+            }
+
+            size_t claimSlot() {
+                for (size_t i = 0; i < maxThreads; ++i) {
+                    bool expected = false;
+                    if (!slots[i].claimed.load(std::memory_order_relaxed) &&
+                        slots[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                        size_t limit = slotLimit.load(std::memory_order_relaxed);
+                        while (limit < i + 1 && !slotLimit.compare_exchange_weak(limit, i + 1)) {}
+                        return i;
+                    }
+                }
+                throw std::runtime_error("Exception: too many reader threads");
+            }
+
+            /**
+             * Moves to the next epoch unless a reader still announces an older one; the caller holds the mutex.
+             */
+            void tryAdvance() {
+                uint64_t current = epoch.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const size_t limit = slotLimit.load(std::memory_order_acquire);
+                for (size_t i = 0; i < limit; ++i) {
+                    const uint64_t state = slots[i].state.load(std::memory_order_acquire);
+                    if ((state & 1) && (state >> 1) != current)
+                        return;
+                }
+                epoch.compare_exchange_strong(current, current + 1);
+            }
+
+            /**
+             * Takes out the retired objects no reader can reach any more; the caller holds the mutex.
+             */
+            std::vector<Retired> collect() {
+                const uint64_t safe = epoch.load(std::memory_order_acquire);
+                const auto firstLive = std::partition(retired.begin(), retired.end(), [safe](const Retired &entry) {
+                    return entry.epoch + 2 <= safe;
+                });
+                std::vector<Retired> result(retired.begin(), firstLive);
+                retired.erase(retired.begin(), firstLive);
+                return result;
+            }
+
+        public:
+            EpochManager(const EpochManager &) = delete;
+
+            static EpochManager &instance() {
+                static EpochManager manager;
+                return manager;
+            }
+
+            void enter() {
+                ThreadState &state = threadState();
+                if (state.depth++ != 0)
+                    return;
+                if (state.slot == none)
+                    state.slot = claimSlot();
+                slots[state.slot].state.store((epoch.load(std::memory_order_relaxed) << 1) | 1,
+                                              std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+
+            void exit() {
+                ThreadState &state = threadState();
+                if (--state.depth == 0)
+                    slots[state.slot].state.store(0, std::memory_order_release);
+            }
+
+            /**
+             * Destroys the object once no reader that may have seen it is still reading.
+             */
+            template<typename T>
+            void retire(T *object) {
+                std::vector<Retired> ready;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    retired.push_back(Retired{epoch.load(std::memory_order_relaxed), object, [](void *pointer) {
+                        delete static_cast<T *>(pointer);
+                    }});
+                    if (retired.size() % reclaimBatch == 0) {
+                        tryAdvance();
+                        ready = collect();
+                    }
+                }
+                for (const Retired &entry : ready)
+                    entry.destroy(entry.object);
+            }
+
+            /**
+             * @return objects retired but not destroyed yet
+             */
+            size_t pending() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return retired.size();
+            }
+        };
+
+        class EpochGuard {
+        public:
+            EpochGuard() {
+                EpochManager::instance().enter();
+            }
+
+            EpochGuard(const EpochGuard &) = delete;
+
+            EpochGuard &operator=(const EpochGuard &) = delete;
+
+            ~EpochGuard() {
+                EpochManager::instance().exit();
+            }
+        };
+
+        /**
+         * Immutable value replaced as a whole: readers load the current version without locks and keep
+         * it as long as they like, the single writer at a time publishes a new one. Superseded versions
+         * stay reachable by readers that already hold them and are freed with their last holder.
+         */
+        template<typename T>
+        class Versioned {
+        private:
+            // the holder is what the epoch protects; the version itself is reference counted
+            std::atomic<std::shared_ptr<const T> *> current;
+
+        public:
+            explicit Versioned(std::shared_ptr<const T> initial)
+                    : current(new std::shared_ptr<const T>(std::move(initial))) {}
+
+            Versioned(const Versioned &) = delete;
+
+            ~Versioned() {
+                delete current.load(std::memory_order_relaxed);
+            }
+
+            std::shared_ptr<const T> load() const {
+                const EpochGuard guard;
+                return *current.load(std::memory_order_acquire);
+            }
+
+            /**
+             * Runs the visitor on the current version without touching its reference count, so readers
+             * of one hot value share no written cache line; the epoch keeps the version alive meanwhile.
+             */
+            template<typename Visitor>
+            auto read(Visitor &&visitor) const -> decltype(visitor(std::declval<const T &>())) {
+                const EpochGuard guard;
+                return visitor(**current.load(std::memory_order_acquire));
+            }
+
+            /**
+             * The version being replaced; only for the writer.
+             */
+            const T &latest() const {
+                return **current.load(std::memory_order_relaxed);
+            }
+
+            void publish(std::shared_ptr<const T> next) {
+                std::shared_ptr<const T> *previous = current.exchange(
+                        new std::shared_ptr<const T>(std::move(next)), std::memory_order_acq_rel);
+                EpochManager::instance().retire(previous);
+            }
+        };
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Compact pending notification: the newest video of a creator plus how many uploads it stands for.
+         */
+        struct InboxRecord {
+            uint64_t videoKey;
+            uint64_t sequence;
+            uint32_t creatorId;
+            uint32_t uploads;
+        };
+
+        enum class InboxOverflowPolicy {
+            DropOldest,
+            DropNewest
+        };
+
+        struct InboxSettings {
+            uint32_t capacity = 64;
+            InboxOverflowPolicy overflowPolicy = InboxOverflowPolicy::DropOldest;
+        };
+
+        /**
+         * Fixed-capacity ring buffer of pending notifications for one user.
+         *
+         * Uploads from a creator that already has a pending record are coalesced into it, so the inbox
+         * holds at most one record per creator, ordered by the sequence of their latest upload. The
+         * buffer is allocated on the first delivery and never grows, so an idle follower costs
+         * O(capacity) no matter how busy the channels they follow are.
+         */
+        class NotificationInbox {
+        private:
+            std::unique_ptr<InboxRecord[]> records;
+            const InboxSettings settings;
+            uint32_t head = 0;
+            uint32_t count = 0;
+
+            InboxRecord &at(const uint32_t index) {
+                return records[(head + index) % settings.capacity];
+            }
+
+        public:
+            explicit NotificationInbox(const InboxSettings settings = InboxSettings()) : settings(settings) {}
+
+            /**
+             * @return false if the record was dropped by the overflow policy
+             */
+            bool push(const uint32_t creatorId, const uint64_t videoKey, const uint64_t sequence) {
+                if (settings.capacity == 0)
+                    return false;
+                if (!records)
+                    records.reset(new InboxRecord[settings.capacity]);
+
+                uint32_t uploads = 1;
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (at(i).creatorId != creatorId)
+                        continue;
+                    uploads += at(i).uploads;
+                    for (uint32_t j = i + 1; j < count; ++j)
+                        at(j - 1) = at(j);
+                    --count;
+                    break;
+                }
+
+                if (count == settings.capacity) {
+                    if (settings.overflowPolicy == InboxOverflowPolicy::DropNewest)
+                        return false;
+                    head = (head + 1) % settings.capacity;
+                    --count;
+                }
+                at(count++) = InboxRecord{videoKey, sequence, creatorId, uploads};
+                return true;
+            }
+
+            template<class F>
+            void forEach(F &&f) {
+                for (uint32_t i = 0; i < count; ++i)
+                    f(at(i));
+            }
+
+            void clear() {
+                head = 0;
+                count = 0;
+            }
+
+            size_t size() const {
+                return count;
+            }
+
+            size_t memoryUsage() const {
+                return records ? settings.capacity * sizeof(InboxRecord) : 0;
+            }
+        };
+    }
+}
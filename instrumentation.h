@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "metrics.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Process-wide store of backend metrics.
+         *
+         * Every thread records into its own shard (call counters and latency histograms per partition and
+         * Backend method, plus notification fan-out sizes), so recording never contends with other threads.
+         * When a thread exits, its shard is folded into one kept for retired threads and dropped.
+         * Every call is counted but only one in latencySampling calls is timed, which keeps clock reads
+         * off most calls. Exporting walks all shards and merges them, and adds gauges pulled from
+         * registered sources.
+         */
+        class MetricsRegistry {
+        public:
+            enum Method {
+                Auth,
+                Logout,
+                RegisterUser,
+                DownloadVideo,
+                SearchVideos,
+                AddVideo,
+                GetVideo,
+                LeaveComment,
+                LeaveReply,
+                LeaveLike,
+                LikeComment,
+                SetClientCallback,
+                SubscribeFor,
+                UnsubscribeFrom,
+                ReleasePendingNotifications,
+                GetTrending,
+                Complete,
+                MethodCount
+            };
+
+            using Gauges = std::vector<std::pair<std::string, double>>;
+            using GaugeSource = std::function<Gauges()>;
+
+            static constexpr size_t maxPartitions = 64;
+            static constexpr uint64_t defaultLatencySampling = 8;
+
+            /**
+             * Counters of one partition and method, written by a single thread.
+             */
+            struct MethodStats {
+                std::atomic<uint64_t> calls{0};
+                std::atomic<uint64_t> errors{0};
+                ConcurrentLatencyHistogram latency;
+
+                /**
+                 * Counts a call; returns whether its latency should be recorded.
+                 */
+                bool begin(const uint64_t sampleMask) {
+                    const uint64_t call = calls.load(std::memory_order_relaxed);
+                    calls.store(call + 1, std::memory_order_relaxed);
+                    return (call & sampleMask) == 0;
+                }
+
+                void fail() {
+                    errors.store(errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+            };
+
+        private:
+            struct Shard {
+                std::array<std::atomic<MethodStats *>, maxPartitions * MethodCount> stats{};
+                std::vector<std::unique_ptr<MethodStats>> owned;
+                ConcurrentLatencyHistogram fanOut;
+
+                MethodStats &at(const size_t partition, const Method method) {
+                    std::atomic<MethodStats *> &slot = stats[partition * MethodCount + method];
+                    MethodStats *result = slot.load(std::memory_order_relaxed);
+                    if (!result) {
+                        owned.push_back(std::make_unique<MethodStats>());
+                        result = owned.back().get();
+                        slot.store(result, std::memory_order_release);
+                    }
+                    return *result;
+                }
+
+                void add(const Shard &other) {
+                    for (size_t i = 0; i < other.stats.size(); ++i) {
+                        const MethodStats *from = other.stats[i].load(std::memory_order_acquire);
+                        if (!from)
+                            continue;
+                        MethodStats &to = at(i / MethodCount, static_cast<Method>(i % MethodCount));
+                        to.calls.store(to.calls.load(std::memory_order_relaxed) +
+                                       from->calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        to.errors.store(to.errors.load(std::memory_order_relaxed) +
+                                        from->errors.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        to.latency.add(from->latency);
+                    }
+                    fanOut.add(other.fanOut);
+                }
+            };
+
+            /**
+             * A thread's shard, retired when the thread exits.
+             */
+            struct LocalShard {
+                MetricsRegistry *registry = nullptr;
+                std::shared_ptr<Shard> shard;
+
+                ~LocalShard() {
+                    if (shard)
+                        registry->retire(shard);
+                }
+            };
+
+            std::mutex mutex;
+            // the first one collects the shards of exited threads and is only written under the mutex
+            std::vector<std::shared_ptr<Shard>> shards{std::make_shared<Shard>()};
+            std::vector<std::string> partitions;
+            std::vector<std::pair<std::string, GaugeSource>> gaugeSources;
+            std::atomic<uint64_t> sampleMask{defaultLatencySampling - 1};
+
+            MetricsRegistry() = default;
+
+            Shard &localShard() {
+                static thread_local LocalShard local;
+                if (!local.shard) {
+                    local.registry = this;
+                    local.shard = std::make_shared<Shard>();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    shards.push_back(local.shard);
+                }
+                return *local.shard;
+            }
+
+            void retire(const std::shared_ptr<Shard> &shard) {
+                std::lock_guard<std::mutex> lock(mutex);
+                shards.front()->add(*shard);
+                shards.erase(std::find(shards.begin(), shards.end(), shard));
+            }
+
+            static void printLatency(std::ostream &out, const LatencyHistogram &latency) {
+                out << " mean_us=" << latency.mean() / 1000.0
+                    << " p50_us=" << latency.valueAt(0.50) / 1000.0
+                    << " p99_us=" << latency.valueAt(0.99) / 1000.0
+                    << " max_us=" << latency.max() / 1000.0;
+            }
+
+        public:
+            MetricsRegistry(const MetricsRegistry &) = delete;
+
+            MetricsRegistry(MetricsRegistry &&) = delete;
+
+            static MetricsRegistry &instance() {
+                static MetricsRegistry registry;
+                return registry;
+            }
+
+            static const char *methodName(const Method method) {
+                static const char *names[MethodCount] = {
+                        "auth", "logout", "registerUser", "downloadVideo", "searchVideos", "addVideo", "getVideo",
+                        "leaveComment", "leaveReply", "leaveLike", "likeComment", "setClientCallback",
+                        "subscribeFor", "unsubscribeFrom", "releasePendingNotifications", "getTrending",
+                        "complete"
+                };
+                return names[method];
+            }
+
+            /**
+             * @return tag to pass to record(); partitions beyond maxPartitions share the last tag
+             */
+            size_t registerPartition(const std::string &name) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (partitions.size() == maxPartitions)
+                    return maxPartitions - 1;
+                partitions.push_back(name);
+                return partitions.size() - 1;
+            }
+
+            void addGaugeSource(const std::string &name, GaugeSource source) {
+                std::lock_guard<std::mutex> lock(mutex);
+                gaugeSources.emplace_back(name, std::move(source));
+            }
+
+            /**
+             * Times one call out of every `calls` (rounded up to a power of two); 1 times every call.
+             */
+            void setLatencySampling(const uint64_t calls) {
+                uint64_t rounded = 1;
+                while (rounded < calls)
+                    rounded <<= 1;
+                sampleMask.store(rounded - 1, std::memory_order_relaxed);
+            }
+
+            uint64_t latencySampleMask() const {
+                return sampleMask.load(std::memory_order_relaxed);
+            }
+
+            MethodStats &methodStats(const size_t partition, const Method method) {
+                return localShard().at(partition, method);
+            }
+
+            void recordFanOut(const size_t followers) {
+                localShard().fanOut.record(followers);
+            }
+
+            /**
+             * Writes one line per partition and method that has been called, then fan-out and gauges.
+             */
+            void report(std::ostream &out) {
+                // held while merging, so that a shard retiring meanwhile is not counted twice
+                std::unique_lock<std::mutex> lock(mutex);
+
+                for (size_t partition = 0; partition < partitions.size(); ++partition) {
+                    for (size_t method = 0; method < MethodCount; ++method) {
+                        LatencyHistogram latency;
+                        uint64_t calls = 0;
+                        uint64_t errors = 0;
+                        for (const std::shared_ptr<Shard> &shard : shards) {
+                            const MethodStats *stats =
+                                    shard->stats[partition * MethodCount + method].load(std::memory_order_acquire);
+                            if (!stats)
+                                continue;
+                            stats->latency.addTo(latency);
+                            calls += stats->calls.load(std::memory_order_relaxed);
+                            errors += stats->errors.load(std::memory_order_relaxed);
+                        }
+                        if (calls == 0)
+                            continue;
+                        out << "backend partition=" << partitions[partition]
+                            << " method=" << methodName(static_cast<Method>(method))
+                            << " calls=" << calls << " errors=" << errors << " timed=" << latency.count();
+                        printLatency(out, latency);
+                        out << '\n';
+                    }
+                }
+
+                LatencyHistogram fanOut;
+                for (const std::shared_ptr<Shard> &shard : shards)
+                    shard->fanOut.addTo(fanOut);
+                out << "fanout uploads=" << fanOut.count() << " mean=" << fanOut.mean()
+                    << " p50=" << fanOut.valueAt(0.50) << " p99=" << fanOut.valueAt(0.99)
+                    << " max=" << fanOut.max() << '\n';
+
+                const std::vector<std::pair<std::string, GaugeSource>> sources = gaugeSources;
+                lock.unlock();
+                for (const auto &source : sources)
+                    for (const auto &gauge : source.second())
+                        out << "gauge source=" << source.first << ' ' << gauge.first << '=' << gauge.second << '\n';
+            }
+        };
+
+        /**
+         * Background thread rewriting a metrics report file at a fixed interval.
+         */
+        class MetricsDumper {
+        private:
+            const std::string path;
+            const std::chrono::milliseconds interval;
+            std::mutex mutex;
+            std::condition_variable stopCondition;
+            bool stopped = false;
+            std::thread thread;
+
+            void dump() {
+                const std::string temporary = path + ".tmp";
+                {
+                    std::ofstream out(temporary, std::ios::trunc);
+                    MetricsRegistry::instance().report(out);
+                }
+                std::rename(temporary.c_str(), path.c_str());
+            }
+
+        public:
+            MetricsDumper(std::string path, const std::chrono::milliseconds interval)
+                    : path(std::move(path)), interval(interval) {
+                thread = std::thread([this] {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!stopCondition.wait_for(lock, this->interval, [this] { return stopped; }))
+                        dump();
+                    dump();
+                });
+            }
+
+            MetricsDumper(const MetricsDumper &) = delete;
+
+            ~MetricsDumper() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopped = true;
+                }
+                stopCondition.notify_all();
+                thread.join();
+            }
+        };
+    }
+}
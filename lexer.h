@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Splits a command line into lexemes separated by spaces, honouring quotes and backslash escapes.
+ *
+ * Lexemes are views into the line whenever their characters are contiguous in it (plain words and
+ * words wrapped in a single pair of quotes); only lexemes with escapes or embedded quotes are copied.
+ * Buffers are reused between calls, so the views stay valid until the next call to split().
+ */
+class Lexer {
+private:
+    std::vector<std::string_view> lexemes;
+    std::deque<std::string> unescaped;
+
+public:
+    const std::vector<std::string_view> &split(const std::string_view line) {
+        lexemes.clear();
+        unescaped.clear();
+
+        char quotes = 0;
+        bool lastSlash = false;
+        bool started = false;
+        size_t begin = 0;
+        size_t end = 0;
+        std::string *buffer = nullptr;
+
+        auto finishLexeme = [&]() {
+            if (buffer) {
+                if (!buffer->empty())
+                    lexemes.emplace_back(*buffer);
+            } else if (started) {
+                lexemes.push_back(line.substr(begin, end - begin));
+            }
+            started = false;
+            buffer = nullptr;
+        };
+
+        auto extendLexeme = [&](const size_t i) {
+            if (buffer) {
+                buffer->push_back(line[i]);
+            } else if (!started) {
+                started = true;
+                begin = i;
+                end = i + 1;
+            } else if (end == i) {
+                ++end;
+            } else {
+                // characters are no longer contiguous in the line: fall back to a copy
+                buffer = &unescaped.emplace_back(line.substr(begin, end - begin));
+                buffer->push_back(line[i]);
+            }
+        };
+
+        for (size_t i = 0; i < line.size(); ++i) {
+            const char c = line[i];
+            if (c == '\\' && !lastSlash) {
+                lastSlash = true;
+                continue;
+            }
+
+            if (c == quotes && !lastSlash) {
+                quotes = 0;
+            } else if ((c == '\'' || c == '"') && !lastSlash) {
+                quotes = c;
+            } else if (c == ' ' && !quotes && !lastSlash) {
+                finishLexeme();
+            } else {
+                extendLexeme(i);
+            }
+
+            lastSlash = false;
+        }
+        finishLexeme();
+
+        return lexemes;
+    }
+};
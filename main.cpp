@@ -1,78 +1,238 @@
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "backend.h"
 #include "client.h"
 #include "cli.h"
+#include "lexer.h"
+#include "remote-backend.h"
+#include "rpc-server.h"
+
+/**
+ * Runs commands from the stream until it ends or 'stop' is read.
+ * @return number of executed commands
+ */
+size_t runCommands(YoutubeCLI &cli, std::istream &input, const bool interactive) {
+    Lexer lexer;
+    std::string line;
+    size_t executed = 0;
+    while (true) {
+        if (interactive) {
+            std::cout << ">> ";
+            std::cout.flush();
+        }
 
-std::vector<std::string> parseToLexemes(const std::string &s) {
-    std::vector<std::string> result;
+        if (!std::getline(input, line))
+            break;
 
-    char quotes = 0;
-    bool lastSlash = false;
-    std::ostringstream builder;
+        const std::vector<std::string_view> &command = lexer.split(line);
+        if (command.size() == 1 && command[0] == "stop")
+            break;
+        if (command.empty() && !interactive)
+            continue;
 
-    auto finishLexeme = [&builder, &result]() mutable {
-        std::string lexeme = builder.str();
-        if (!lexeme.empty())
-            result.push_back(std::move(lexeme));
+        cli.handleNextCommand(command);
+        ++executed;
+    }
+    return executed;
+}
 
-        builder.str("");
-        builder.clear();
-    };
+bool parseCount(const std::string &value, size_t &count) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    try {
+        count = std::stoull(value);
+    } catch (const std::out_of_range &) {
+        return false;
+    }
+    return true;
+}
 
-    for (char c : s) {
-        if (c == '\\' && !lastSlash) {
-            lastSlash = true;
-            continue;
-        }
+void printUsage(const char *program) {
+    std::cerr << "usage: " << program
+              << " [--batch [command-file]] [--stats-file path [--stats-interval seconds] [--latency-sampling N]]"
+              << " [--serve socket-path | --connect socket-path] [--replicas N]"
+              << " [--inbox-capacity N] [--inbox-overflow drop-oldest|drop-newest]" << std::endl;
+}
 
-        if (c == quotes && !lastSlash) {
-            quotes = 0;
-        } else if ((c == '\'' || c == '"') && !lastSlash) {
-            quotes = c;
-        } else if (c == ' ' && !quotes && !lastSlash) {
-            // finish current lexeme
-            finishLexeme();
+int main(int argc, char **argv) {
+    bool batch = false;
+    std::string commandFile;
+    std::string statsFile;
+    size_t statsInterval = 10;
+    size_t latencySampling = youtube::backend::MetricsRegistry::defaultLatencySampling;
+    std::string servePath;
+    std::string connectPath;
+    size_t replicaCount = 2;
+    youtube::backend::InboxSettings inboxSettings;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--batch") {
+            batch = true;
+            if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0)
+                commandFile = argv[++i];
+        } else if (arg == "--stats-file" && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (arg == "--stats-interval" && i + 1 < argc) {
+            if (!parseCount(argv[++i], statsInterval) || statsInterval == 0) {
+                std::cerr << "bad value for " << arg << ": " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--latency-sampling" && i + 1 < argc) {
+            if (!parseCount(argv[++i], latencySampling) || latencySampling == 0) {
+                std::cerr << "bad value for " << arg << ": " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--serve" && i + 1 < argc) {
+            servePath = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connectPath = argv[++i];
+        } else if (arg == "--replicas" && i + 1 < argc) {
+            if (!parseCount(argv[++i], replicaCount)) {
+                std::cerr << "bad value for " << arg << ": " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--inbox-capacity" && i + 1 < argc) {
+            size_t capacity;
+            if (!parseCount(argv[++i], capacity) || capacity > UINT32_MAX) {
+                std::cerr << "bad value for " << arg << ": " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            inboxSettings.capacity = static_cast<uint32_t>(capacity);
+        } else if (arg == "--inbox-overflow" && i + 1 < argc) {
+            const std::string policy = argv[++i];
+            if (policy == "drop-oldest") {
+                inboxSettings.overflowPolicy = youtube::backend::InboxOverflowPolicy::DropOldest;
+            } else if (policy == "drop-newest") {
+                inboxSettings.overflowPolicy = youtube::backend::InboxOverflowPolicy::DropNewest;
+            } else {
+                std::cerr << "bad value for " << arg << ": " << policy << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
         } else {
-            // extend current lexeme
-            builder << c;
+            printUsage(argv[0]);
+            return 1;
         }
-
-        lastSlash = false;
     }
-    finishLexeme();
 
-    return result;
-}
+    // signals are taken by a dedicated thread in server mode, so block them before any thread starts
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    if (!servePath.empty())
+        pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    std::shared_ptr<youtube::Backend> backend;
+    if (connectPath.empty()) {
+        // one in this many backend calls is timed
+        youtube::backend::MetricsRegistry::instance().setLatencySampling(latencySampling);
+        // pending notifications kept per user until they are released
+        youtube::backend::DataStorage::instance().setInboxSettings(inboxSettings);
+        std::vector<std::shared_ptr<youtube::Backend>> partitions;
+        for (size_t i = 0; i < 3; ++i) {
+            partitions.push_back(std::make_shared<youtube::backend::InstrumentedBackend>(
+                    "partition-" + std::to_string(i), std::make_shared<youtube::backend::BackendImpl>()));
+        }
+        const auto log = std::make_shared<youtube::backend::ReplicationLog>();
+        std::vector<youtube::backend::ReadReplica> replicas;
+        for (size_t i = 0; i < replicaCount; ++i) {
+            const auto replica = std::make_shared<youtube::backend::Replica>(log);
+            replicas.push_back({std::make_shared<youtube::backend::InstrumentedBackend>(
+                    "replica-" + std::to_string(i), replica->getBackend()), replica});
+        }
+        if (!replicas.empty()) {
+            youtube::backend::DataStorage::instance().setReplicationLog(log);
+            youtube::backend::MetricsRegistry::instance().addGaugeSource("replication", [log, replicas] {
+                youtube::backend::MetricsRegistry::Gauges gauges{
+                        {"log_sequence", static_cast<double>(log->lastSequence())},
+                        {"log_backlog",  static_cast<double>(log->backlog())}};
+                for (size_t i = 0; i < replicas.size(); ++i)
+                    gauges.emplace_back("replica_" + std::to_string(i) + "_lag",
+                                        static_cast<double>(replicas[i].replica->lag()));
+                return gauges;
+            });
+        }
+        backend = std::make_shared<youtube::backend::Proxy>(partitions, replicas, log);
+    } else {
+        backend = std::make_shared<youtube::client::RemoteBackend>(connectPath);
+    }
+    youtube::client::StandardYoutubeClientFactory factory{backend};
 
-int main() {
-    std::cout << "Hello, Youtuber!" << std::endl;
+    // sessions of the local backend expire, and drop their notification callbacks, without waiting for a login
+    std::unique_ptr<youtube::backend::SessionReaper> sessionReaper;
+    if (connectPath.empty())
+        sessionReaper = std::make_unique<youtube::backend::SessionReaper>();
 
-    const std::shared_ptr<youtube::Backend> backend{
-            new youtube::backend::Proxy({
-                                                std::make_shared<youtube::backend::BackendImpl>(),
-                                                std::make_shared<youtube::backend::BackendImpl>(),
-                                                std::make_shared<youtube::backend::BackendImpl>()
-                                        })
+    std::unique_ptr<youtube::backend::MetricsDumper> dumper;
+    if (!statsFile.empty())
+        dumper = std::make_unique<youtube::backend::MetricsDumper>(statsFile, std::chrono::seconds(statsInterval));
+    auto statsReporter = [](std::ostream &out) {
+        youtube::backend::MetricsRegistry::instance().report(out);
     };
-    youtube::client::StandardYoutubeClientFactory factory{backend};
-
-    YoutubeCLI cli{std::cin, std::cout, factory.openConnection()};
-    while (true) {
-        std::cout << ">> ";
-        std::cout.flush();
 
-        std::string cmd;
-        std::getline(std::cin, cmd);
+    if (!servePath.empty()) {
+        youtube::backend::RpcServer server{backend, servePath};
+        std::thread signalWaiter([&server, &stopSignals] {
+            int signal;
+            sigwait(&stopSignals, &signal);
+            server.stop();
+        });
+        std::cerr << "Serving on " << servePath << std::endl;
+        try {
+            server.run();
+        } catch (const std::exception &exception) {
+            // the waiter only returns from sigwait on a stop signal, so send it one to join it
+            pthread_kill(signalWaiter.native_handle(), SIGTERM);
+            signalWaiter.join();
+            std::cerr << exception.what() << std::endl;
+            return 1;
+        }
+        signalWaiter.join();
+        return 0;
+    }
 
-        const std::vector<std::string> command = parseToLexemes(cmd);
-        if (command.size() == 1 && command[0] == "stop")
-            break;
+    if (!batch) {
+        std::cout << "Hello, Youtuber!" << std::endl;
+        YoutubeCLI cli{std::cin, std::cout, factory.openConnection()};
+        if (connectPath.empty())
+            cli.setStatsReporter(statsReporter);
+        runCommands(cli, std::cin, true);
+        return 0;
+    }
 
-        cli.handleNextCommand(command);
+    std::ios::sync_with_stdio(false);
+    std::ifstream file;
+    if (!commandFile.empty()) {
+        file.open(commandFile);
+        if (!file) {
+            std::cerr << "cannot open " << commandFile << std::endl;
+            return 1;
+        }
     }
+    std::istream &input = commandFile.empty() ? std::cin : static_cast<std::istream &>(file);
+
+    YoutubeCLI cli{input, std::cout, factory.openConnection(), false};
+    if (connectPath.empty())
+        cli.setStatsReporter(statsReporter);
+    const auto start = std::chrono::steady_clock::now();
+    const size_t executed = runCommands(cli, input, false);
+    std::cout.flush();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << executed << " commands in " << seconds << " s ("
+              << static_cast<double>(executed) / seconds << " commands/s)" << std::endl;
 
     return 0;
 }
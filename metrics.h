@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace youtube {
+    /**
+     * Log-linear latency histogram in the spirit of HdrHistogram: every power of two is split into
+     * 2^subBucketBits linear sub-buckets, so any recorded value is reproduced within 1% while the
+     * whole 64-bit range fits in a fixed array of counters. Recording is a couple of shifts and one
+     * increment; histograms from several threads are combined with add().
+     */
+    class LatencyHistogram {
+        friend class ConcurrentLatencyHistogram;
+
+    private:
+        static constexpr int subBucketBits = 7;
+        static constexpr uint64_t subBucketCount = uint64_t{1} << subBucketBits;
+        static constexpr size_t bucketCount = (65 - subBucketBits) * subBucketCount;
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+        uint64_t sum = 0;
+        uint64_t maxValue = 0;
+        uint64_t minValue = UINT64_MAX;
+
+        static int mostSignificantBit(const uint64_t value) {
+            return 63 - __builtin_clzll(value);
+        }
+
+        static size_t indexOf(const uint64_t value) {
+            if (value < subBucketCount)
+                return static_cast<size_t>(value);
+            const int shift = mostSignificantBit(value) - subBucketBits;
+            return static_cast<size_t>((shift + 1) * subBucketCount + ((value >> shift) - subBucketCount));
+        }
+
+        static uint64_t lowestValueAt(const size_t index) {
+            const uint64_t group = index / subBucketCount;
+            const uint64_t offset = index % subBucketCount;
+            if (group == 0)
+                return offset;
+            return (subBucketCount + offset) << (group - 1);
+        }
+
+    public:
+        LatencyHistogram() : counts(bucketCount, 0) {}
+
+        void record(const uint64_t value) {
+            ++counts[indexOf(value)];
+            ++total;
+            sum += value;
+            maxValue = std::max(maxValue, value);
+            minValue = std::min(minValue, value);
+        }
+
+        void add(const LatencyHistogram &other) {
+            for (size_t i = 0; i < bucketCount; ++i)
+                counts[i] += other.counts[i];
+            total += other.total;
+            sum += other.sum;
+            maxValue = std::max(maxValue, other.maxValue);
+            minValue = std::min(minValue, other.minValue);
+        }
+
+        void reset() {
+            std::fill(counts.begin(), counts.end(), 0);
+            total = sum = maxValue = 0;
+            minValue = UINT64_MAX;
+        }
+
+        uint64_t count() const {
+            return total;
+        }
+
+        uint64_t max() const {
+            return maxValue;
+        }
+
+        uint64_t min() const {
+            return total ? minValue : 0;
+        }
+
+        double mean() const {
+            return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0;
+        }
+
+        /**
+         * @param quantile in [0, 1]
+         * @return the highest value equivalent to the one at the quantile, capped by the recorded maximum
+         */
+        uint64_t valueAt(const double quantile) const {
+            if (total == 0)
+                return 0;
+            const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucketCount; ++i) {
+                seen += counts[i];
+                if (seen >= rank)
+                    return std::min(maxValue, lowestValueAt(i + 1) - 1);
+            }
+            return maxValue;
+        }
+    };
+
+    /**
+     * LatencyHistogram with a single writer thread and any number of concurrent readers.
+     * The writer bumps counters with plain relaxed load/store pairs, so recording stays free of
+     * locked instructions; readers take a consistent-enough copy with addTo().
+     */
+    class ConcurrentLatencyHistogram {
+    private:
+        const std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> maxValue{0};
+        std::atomic<uint64_t> minValue{UINT64_MAX};
+
+        static void bump(std::atomic<uint64_t> &counter, const uint64_t by = 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+    public:
+        ConcurrentLatencyHistogram() : counts(new std::atomic<uint64_t>[LatencyHistogram::bucketCount]) {
+            for (size_t i = 0; i < LatencyHistogram::bucketCount; ++i)
+                counts[i].store(0, std::memory_order_relaxed);
+        }
+
+        void record(const uint64_t value) {
+            bump(counts[LatencyHistogram::indexOf(value)]);
+            bump(total);
+            bump(sum, value);
+            if (value > maxValue.load(std::memory_order_relaxed))
+                maxValue.store(value, std::memory_order_relaxed);
+            if (value < minValue.load(std::memory_order_relaxed))
+                minValue.store(value, std::memory_order_relaxed);
+        }
+
+        uint64_t count() const {
+            return total.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Adds another histogram's counts; like record(), only one thread at a time may do so.
+         */
+        void add(const ConcurrentLatencyHistogram &other) {
+            for (size_t i = 0; i < LatencyHistogram::bucketCount; ++i)
+                bump(counts[i], other.counts[i].load(std::memory_order_relaxed));
+            bump(total, other.total.load(std::memory_order_relaxed));
+            bump(sum, other.sum.load(std::memory_order_relaxed));
+            const uint64_t otherMax = other.maxValue.load(std::memory_order_relaxed);
+            if (otherMax > maxValue.load(std::memory_order_relaxed))
+                maxValue.store(otherMax, std::memory_order_relaxed);
+            const uint64_t otherMin = other.minValue.load(std::memory_order_relaxed);
+            if (otherMin < minValue.load(std::memory_order_relaxed))
+                minValue.store(otherMin, std::memory_order_relaxed);
+        }
+
+        void addTo(LatencyHistogram &target) const {
+            for (size_t i = 0; i < LatencyHistogram::bucketCount; ++i) {
+                const uint64_t value = counts[i].load(std::memory_order_relaxed);
+                target.counts[i] += value;
+                target.total += value;
+            }
+            target.sum += sum.load(std::memory_order_relaxed);
+            target.maxValue = std::max(target.maxValue, maxValue.load(std::memory_order_relaxed));
+            target.minValue = std::min(target.minValue, minValue.load(std::memory_order_relaxed));
+        }
+    };
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "crypto.h"
+#include "util.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Salted PBKDF2-HMAC-SHA256 password hash. The iteration count is stored with the hash,
+         * so the work factor can be raised without invalidating existing accounts.
+         */
+        struct PasswordHash {
+            std::array<uint8_t, 16> salt{};
+            uint32_t iterations = 0;
+            Sha256::Digest digest{};
+
+            static PasswordHash compute(const std::string &password, const uint32_t iterations) {
+                PasswordHash result;
+                for (size_t i = 0; i < result.salt.size(); i += 8) {
+                    const uint64_t random = SecureRandomGenerator::instance().nextUInt64();
+                    std::memcpy(result.salt.data() + i, &random, 8);
+                }
+                result.iterations = iterations;
+                result.digest = pbkdf2Sha256(password, result.salt.data(), result.salt.size(), iterations);
+                return result;
+            }
+
+            bool matches(const std::string &password) const {
+                return constantTimeEquals(digest, pbkdf2Sha256(password, salt.data(), salt.size(), iterations));
+            }
+
+            /**
+             * Single-round salted digest used to recognise a recently verified password.
+             */
+            Sha256::Digest quickDigest(const std::string &password) const {
+                return Sha256().update(digest.data(), digest.size()).update(salt.data(), salt.size())
+                        .update(password).finish();
+            }
+        };
+
+        /**
+         * Runs password hashing on a dedicated bounded pool of worker threads, so that a burst of logins
+         * queues up behind a fixed number of cores instead of occupying every request thread. When the
+         * queue is full requests are rejected straight away rather than piling up.
+         *
+         * Successful verifications are remembered for a short time, keyed by user, so an immediate
+         * re-authentication costs one SHA-256 instead of the full work factor.
+         */
+        class PasswordVerifier {
+        public:
+            enum class Verdict {
+                Accepted,
+                Rejected,
+                Overloaded
+            };
+
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr uint32_t defaultWorkFactor = 10000;
+            static constexpr size_t defaultQueueCapacity = 1024;
+            static constexpr std::chrono::seconds defaultCacheTimeToLive = std::chrono::seconds(60);
+            static constexpr size_t defaultCacheCapacity = 1 << 16;
+
+        private:
+            struct CacheEntry {
+                Sha256::Digest quickDigest;
+                Clock::time_point expiresAt;
+            };
+
+            const uint32_t workFactor;
+            const size_t queueCapacity;
+            const Clock::duration cacheTimeToLive;
+            const size_t cacheCapacity;
+
+            std::mutex queueMutex;
+            std::condition_variable queueCondition;
+            std::deque<std::function<void()>> queue;
+            std::vector<std::thread> workers;
+            bool stopped = false;
+
+            std::mutex cacheMutex;
+            std::unordered_map<uint32_t, CacheEntry> cache;
+
+            void work() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(queueMutex);
+                        queueCondition.wait(lock, [this] { return stopped || !queue.empty(); });
+                        if (queue.empty())
+                            return;
+                        task = std::move(queue.front());
+                        queue.pop_front();
+                    }
+                    task();
+                }
+            }
+
+            template<class R>
+            bool submit(std::packaged_task<R()> &task) {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                if (queue.size() >= queueCapacity)
+                    return false;
+                auto shared = std::make_shared<std::packaged_task<R()>>(std::move(task));
+                queue.emplace_back([shared] { (*shared)(); });
+                queueCondition.notify_one();
+                return true;
+            }
+
+            bool cached(const uint32_t userId, const Sha256::Digest &quickDigest) {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                const auto found = cache.find(userId);
+                if (found == cache.end())
+                    return false;
+                if (found->second.expiresAt <= Clock::now()) {
+                    cache.erase(found);
+                    return false;
+                }
+                return constantTimeEquals(found->second.quickDigest, quickDigest);
+            }
+
+            void remember(const uint32_t userId, const Sha256::Digest &quickDigest) {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                if (cache.size() >= cacheCapacity && cache.find(userId) == cache.end())
+                    cache.erase(cache.begin());
+                cache[userId] = CacheEntry{quickDigest, Clock::now() + cacheTimeToLive};
+            }
+
+        public:
+            explicit PasswordVerifier(const size_t threads = std::max(1u, std::thread::hardware_concurrency() / 2),
+                                      const uint32_t workFactor = defaultWorkFactor,
+                                      const size_t queueCapacity = defaultQueueCapacity,
+                                      const Clock::duration cacheTimeToLive = defaultCacheTimeToLive,
+                                      const size_t cacheCapacity = defaultCacheCapacity)
+                    : workFactor(workFactor), queueCapacity(queueCapacity),
+                      cacheTimeToLive(cacheTimeToLive), cacheCapacity(cacheCapacity) {
+                for (size_t i = 0; i < threads; ++i)
+                    workers.emplace_back([this] { work(); });
+            }
+
+            PasswordVerifier(const PasswordVerifier &) = delete;
+
+            PasswordVerifier(PasswordVerifier &&) = delete;
+
+            ~PasswordVerifier() {
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    stopped = true;
+                }
+                queueCondition.notify_all();
+                for (std::thread &worker : workers)
+                    worker.join();
+            }
+
+            static PasswordVerifier &instance() {
+                static PasswordVerifier verifier;
+                return verifier;
+            }
+
+            /**
+             * Hashes a new password on the worker pool; returns false if the pool is overloaded.
+             */
+            bool hash(const std::string &password, PasswordHash &result) {
+                std::packaged_task<PasswordHash()> task([&password, iterations = workFactor] {
+                    return PasswordHash::compute(password, iterations);
+                });
+                std::future<PasswordHash> future = task.get_future();
+                if (!submit(task))
+                    return false;
+                result = future.get();
+                return true;
+            }
+
+            Verdict verify(const uint32_t userId, const std::string &password, const PasswordHash &hash) {
+                const Sha256::Digest quickDigest = hash.quickDigest(password);
+                if (cached(userId, quickDigest))
+                    return Verdict::Accepted;
+
+                std::packaged_task<bool()> task([&password, &hash] {
+                    return hash.matches(password);
+                });
+                std::future<bool> future = task.get_future();
+                if (!submit(task))
+                    return Verdict::Overloaded;
+                if (!future.get())
+                    return Verdict::Rejected;
+                remember(userId, quickDigest);
+                return Verdict::Accepted;
+            }
+
+            void forget(const uint32_t userId) {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                cache.erase(userId);
+            }
+        };
+    }
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "rpc.h"
+
+namespace youtube {
+    namespace client {
+        /**
+         * Backend living in another process behind an RpcServer.
+         *
+         * All calls share one connection: each request gets its own id and waits for the matching
+         * response, so calls from several threads are pipelined rather than serialized. A reader thread
+         * dispatches responses and pushed notifications; the latter reach callbacks registered with
+         * setClientCallback, held weakly like the in-process backend does. Backend exceptions are
+         * rethrown with their original types.
+         */
+        class RemoteBackend : public Backend {
+        private:
+            int fd = -1;
+            std::thread reader;
+            std::mutex writeMutex;
+            std::mutex pendingMutex;
+            bool disconnected = false;
+            std::unordered_map<uint32_t, std::promise<std::string>> pending;
+            std::unordered_map<uint32_t, std::weak_ptr<ClientCallback>> callbacks;
+            std::atomic<uint32_t> nextId{0};
+
+            void send(const std::string &frame, const std::string &trailing) {
+                iovec buffers[2] = {{const_cast<char *>(frame.data()), frame.size()},
+                                    {const_cast<char *>(trailing.data()), trailing.size()}};
+                int first = 0;
+                std::lock_guard<std::mutex> lock(writeMutex);
+                while (first < 2) {
+                    msghdr message{};
+                    message.msg_iov = buffers + first;
+                    message.msg_iovlen = 2 - first;
+                    // a server that went away fails the call with EPIPE instead of raising SIGPIPE
+                    const ssize_t written = sendmsg(fd, &message, MSG_NOSIGNAL);
+                    if (written < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::runtime_error("Exception: connection to backend lost");
+                    }
+                    size_t left = static_cast<size_t>(written);
+                    while (first < 2 && left >= buffers[first].iov_len)
+                        left -= buffers[first++].iov_len;
+                    if (first < 2) {
+                        buffers[first].iov_base = static_cast<char *>(buffers[first].iov_base) + left;
+                        buffers[first].iov_len -= left;
+                    }
+                }
+            }
+
+            /**
+             * Sends a request and blocks for its response.
+             * @param trailing optional last string argument, sent after the frame without copying
+             * @return the whole response of a successful call, read it with payloadOf()
+             */
+            std::string call(const rpc::MessageType type, const std::vector<const std::string *> &arguments,
+                             const std::string *trailing = nullptr) {
+                const uint32_t id = ++nextId;
+                rpc::MessageWriter request(type, id);
+                for (const std::string *argument : arguments)
+                    request.writeString(*argument);
+                if (!trailing)
+                    return call(id, request.finish());
+                request.writeU32(static_cast<uint32_t>(trailing->size()));
+                return call(id, request.finish(trailing->size()), *trailing);
+            }
+
+            std::string call(const uint32_t id, const std::string &frame, const std::string &trailing = std::string()) {
+                std::future<std::string> response;
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    if (disconnected)
+                        throw std::runtime_error("Exception: connection to backend lost");
+                    response = pending[id].get_future();
+                }
+                try {
+                    send(frame, trailing);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    pending.erase(id);
+                    throw;
+                }
+                const std::string result = response.get();
+
+                rpc::MessageReader reader(result.data(), result.size());
+                const auto status = static_cast<rpc::Status>(reader.readU8());
+                switch (status) {
+                    case rpc::Status::Ok:
+                        return result;
+                    case rpc::Status::NoSuchUser:
+                        throw backend::NoSuchUserException();
+                    case rpc::Status::UserAlreadyExists:
+                        throw backend::UserAlreadyExistsException();
+                    case rpc::Status::NoSuchVideo:
+                        throw backend::NoSuchVideoException();
+                    case rpc::Status::NoSuchComment:
+                        throw backend::NoSuchCommentException();
+                    case rpc::Status::NotAuthorized:
+                        throw backend::NotAuthorizedException();
+                    case rpc::Status::WrongPassword:
+                        throw backend::WrongPasswordException();
+                    case rpc::Status::ServiceOverloaded:
+                        throw backend::ServiceOverloadedException();
+                    default:
+                        throw std::runtime_error(reader.readString());
+                }
+            }
+
+            static rpc::MessageReader payloadOf(const std::string &response) {
+                return rpc::MessageReader(response.data() + 1, response.size() - 1);
+            }
+
+            std::string callWithIndex(const rpc::MessageType type, const std::vector<const std::string *> &arguments,
+                                      const uint64_t index) {
+                const uint32_t id = ++nextId;
+                rpc::MessageWriter request(type, id);
+                for (const std::string *argument : arguments)
+                    request.writeString(*argument);
+                request.writeU64(index);
+                return call(id, request.finish());
+            }
+
+            void dispatch(const rpc::MessageType type, const uint32_t id, const char *payload, const size_t size) {
+                if (type == rpc::MessageType::Notification) {
+                    std::shared_ptr<ClientCallback> callback;
+                    {
+                        std::lock_guard<std::mutex> lock(pendingMutex);
+                        const auto found = callbacks.find(id);
+                        if (found == callbacks.end())
+                            return;
+                        callback = found->second.lock();
+                        if (!callback) {
+                            callbacks.erase(found);
+                            return;
+                        }
+                    }
+                    rpc::MessageReader message(payload, size);
+                    const uint64_t uploads = message.readU64();
+                    (*callback)(std::make_shared<Notification>(message.readVideo(), static_cast<size_t>(uploads)));
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                const auto found = pending.find(id);
+                if (found == pending.end())
+                    return;
+                found->second.set_value(std::string(payload, size));
+                pending.erase(found);
+            }
+
+            void readLoop() {
+                std::string buffer;
+                size_t offset = 0;
+                try {
+                    while (true) {
+                        const size_t size = buffer.size();
+                        buffer.resize(size + 64 * 1024);
+                        const ssize_t received = recv(fd, &buffer[size], 64 * 1024, 0);
+                        buffer.resize(size + std::max<ssize_t>(received, 0));
+                        if (received < 0 && errno == EINTR)
+                            continue;
+                        if (received <= 0)
+                            break;
+
+                        rpc::MessageType type;
+                        uint32_t id;
+                        const char *payload;
+                        size_t payloadSize;
+                        while (rpc::nextFrame(buffer, offset, type, id, payload, payloadSize))
+                            dispatch(type, id, payload, payloadSize);
+                        buffer.erase(0, offset);
+                        offset = 0;
+                    }
+                } catch (const rpc::ProtocolException &) {
+                }
+
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                disconnected = true;
+                for (auto &entry : pending)
+                    entry.second.set_exception(std::make_exception_ptr(
+                            std::runtime_error("Exception: connection to backend lost")));
+                pending.clear();
+            }
+
+        public:
+            explicit RemoteBackend(const std::string &path) {
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+                if (path.size() >= sizeof(address.sun_path))
+                    throw std::runtime_error("Exception: socket path too long");
+                path.copy(address.sun_path, path.size());
+
+                fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+                    if (fd >= 0)
+                        close(fd);
+                    throw std::runtime_error("Exception: cannot connect to " + path);
+                }
+                reader = std::thread([this] { readLoop(); });
+            }
+
+            RemoteBackend(const RemoteBackend &) = delete;
+
+            ~RemoteBackend() {
+                shutdown(fd, SHUT_RDWR);
+                reader.join();
+                close(fd);
+            }
+
+            const std::string auth(const std::string &name, const std::string &password) override {
+                return payloadOf(call(rpc::MessageType::Auth, {&name, &password})).readString();
+            }
+
+            void logout(const std::string &authToken) override {
+                call(rpc::MessageType::Logout, {&authToken});
+            }
+
+            const std::string downloadVideo(const std::string &id) override {
+                return downloadVideo(std::string(), id);
+            }
+
+            const std::string downloadVideo(const std::string &authToken, const std::string &id) override {
+                const std::string response = call(rpc::MessageType::DownloadVideo, {&id, &authToken});
+                return payloadOf(response).readString();
+            }
+
+            void registerUser(const std::string &name, const std::string &password) override {
+                call(rpc::MessageType::RegisterUser, {&name, &password});
+            }
+
+            const std::vector<std::shared_ptr<Video>> searchVideos(const std::vector<std::string> &request) override {
+                return searchVideos(std::string(), request);
+            }
+
+            const std::vector<std::shared_ptr<Video>>
+            searchVideos(const std::string &authToken, const std::vector<std::string> &request) override {
+                const uint32_t id = ++nextId;
+                rpc::MessageWriter message(rpc::MessageType::SearchVideos, id);
+                message.writeU32(static_cast<uint32_t>(request.size()));
+                for (const std::string &word : request)
+                    message.writeString(word);
+                message.writeString(authToken);
+                const std::string response = call(id, message.finish());
+
+                rpc::MessageReader reader = payloadOf(response);
+                std::vector<std::shared_ptr<Video>> result(reader.readU32());
+                for (std::shared_ptr<Video> &video : result)
+                    video = reader.readVideo();
+                return result;
+            }
+
+            void addVideo(const std::string &authToken, const std::string &name, const std::string &content) override {
+                call(rpc::MessageType::AddVideo, {&authToken, &name}, &content);
+            }
+
+            const std::shared_ptr<Video> getVideo(const std::string &id) override {
+                return getVideo(std::string(), id);
+            }
+
+            const std::shared_ptr<Video> getVideo(const std::string &authToken, const std::string &id) override {
+                const std::string response = call(rpc::MessageType::GetVideo, {&id, &authToken});
+                return payloadOf(response).readVideo();
+            }
+
+            void leaveComment(const std::string &authToken, const std::string &videoId,
+                              const std::string &comment) override {
+                call(rpc::MessageType::LeaveComment, {&authToken, &videoId, &comment});
+            }
+
+            void leaveComment(const std::string &authToken, const std::string &videoId, const std::string &comment,
+                              size_t replyToIndex) override {
+                callWithIndex(rpc::MessageType::LeaveReply, {&authToken, &videoId, &comment}, replyToIndex);
+            }
+
+            void leaveLike(const std::string &authToken, const std::string &videoId) override {
+                call(rpc::MessageType::LeaveLike, {&authToken, &videoId});
+            }
+
+            void leaveLike(const std::string &authToken, const std::string &videoId, size_t likeId) override {
+                callWithIndex(rpc::MessageType::LikeComment, {&authToken, &videoId}, likeId);
+            }
+
+            void
+            setClientCallback(const std::string &authToken, const std::shared_ptr<ClientCallback> callback) override {
+                const uint32_t id = ++nextId;
+                {
+                    // registered before sending: the server may push notifications as soon as it handles the request
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    callbacks[id] = callback;
+                }
+                rpc::MessageWriter message(rpc::MessageType::SetClientCallback, id);
+                message.writeString(authToken);
+                try {
+                    call(id, message.finish());
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    callbacks.erase(id);
+                    throw;
+                }
+            }
+
+            void subscribeFor(const std::string &authToken, const std::string &userName) override {
+                call(rpc::MessageType::SubscribeFor, {&authToken, &userName});
+            }
+
+            void unsubscribeFrom(const std::string &authToken, const std::string &userName) override {
+                call(rpc::MessageType::UnsubscribeFrom, {&authToken, &userName});
+            }
+
+            void releasePendingNotifications(const std::string &authToken) override {
+                call(rpc::MessageType::ReleasePendingNotifications, {&authToken});
+            }
+
+            const std::vector<TrendingVideo> getTrending(const TrendingWindow window, const size_t count) override {
+                const uint32_t id = ++nextId;
+                rpc::MessageWriter message(rpc::MessageType::GetTrending, id);
+                message.writeU8(static_cast<uint8_t>(window));
+                message.writeU32(static_cast<uint32_t>(std::min<size_t>(count, UINT32_MAX)));
+                const std::string response = call(id, message.finish());
+
+                rpc::MessageReader reader = payloadOf(response);
+                std::vector<TrendingVideo> result(reader.readU32());
+                for (TrendingVideo &entry : result) {
+                    entry.events = static_cast<size_t>(reader.readU64());
+                    entry.video = reader.readVideo();
+                }
+                return result;
+            }
+
+            const Completions complete(const std::string &prefix, const size_t count) override {
+                const uint32_t id = ++nextId;
+                rpc::MessageWriter message(rpc::MessageType::Complete, id);
+                message.writeString(prefix);
+                message.writeU32(static_cast<uint32_t>(std::min<size_t>(count, UINT32_MAX)));
+                const std::string response = call(id, message.finish());
+
+                rpc::MessageReader reader = payloadOf(response);
+                Completions result;
+                result.videos.resize(reader.readU32());
+                for (std::shared_ptr<Video> &video : result.videos)
+                    video = reader.readVideo();
+                result.userNames.resize(reader.readU32());
+                for (std::string &name : result.userNames)
+                    name = reader.readString();
+                return result;
+            }
+        };
+    }
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "password.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * One state change of the primary storage, replayed by replicas in sequence order.
+         * Only state served by replicas is logged: users, videos with their comments and likes,
+         * and subscriptions. Sessions and pending notifications stay on the primary.
+         */
+        struct Mutation {
+            enum class Kind : uint8_t {
+                CreateUser,
+                CreateVideo,
+                Comment,
+                Reply,
+                LikeVideo,
+                LikeComment,
+                Subscribe,
+                Unsubscribe
+            };
+
+            Kind kind;
+            uint64_t sequence = 0;
+            uint64_t videoKey = 0;
+            uint64_t index = 0;
+            uint32_t userId = 0;
+            uint32_t targetId = 0;
+            std::string name;
+            std::string text;
+            std::shared_ptr<const std::string> content;
+            PasswordHash password;
+
+            explicit Mutation(const Kind kind) : kind(kind) {}
+
+            static Mutation createUser(const std::string &name, const PasswordHash &password) {
+                Mutation result(Kind::CreateUser);
+                result.name = name;
+                result.password = password;
+                return result;
+            }
+
+            static Mutation createVideo(const uint64_t videoKey, const uint32_t ownerId, const std::string &title,
+                                        const std::string &content) {
+                Mutation result(Kind::CreateVideo);
+                result.videoKey = videoKey;
+                result.userId = ownerId;
+                result.text = title;
+                result.content = std::make_shared<const std::string>(content);
+                return result;
+            }
+
+            static Mutation comment(const uint64_t videoKey, const std::string &userName, const std::string &text) {
+                Mutation result(Kind::Comment);
+                result.videoKey = videoKey;
+                result.name = userName;
+                result.text = text;
+                return result;
+            }
+
+            static Mutation reply(const uint64_t videoKey, const uint64_t index, const std::string &userName,
+                                  const std::string &text) {
+                Mutation result = comment(videoKey, userName, text);
+                result.kind = Kind::Reply;
+                result.index = index;
+                return result;
+            }
+
+            static Mutation likeVideo(const uint64_t videoKey, const std::string &userName) {
+                Mutation result(Kind::LikeVideo);
+                result.videoKey = videoKey;
+                result.name = userName;
+                return result;
+            }
+
+            static Mutation likeComment(const uint64_t videoKey, const uint64_t index, const std::string &userName) {
+                Mutation result = likeVideo(videoKey, userName);
+                result.kind = Kind::LikeComment;
+                result.index = index;
+                return result;
+            }
+
+            static Mutation subscribe(const uint32_t followerId, const uint32_t creatorId) {
+                Mutation result(Kind::Subscribe);
+                result.userId = followerId;
+                result.targetId = creatorId;
+                return result;
+            }
+
+            static Mutation unsubscribe(const uint32_t followerId, const uint32_t creatorId) {
+                Mutation result = subscribe(followerId, creatorId);
+                result.kind = Kind::Unsubscribe;
+                return result;
+            }
+        };
+
+        /**
+         * Ordered log of primary mutations shipped to replicas.
+         *
+         * The primary appends under its own write lock, which fixes the order; appending is a short
+         * critical section and never waits for replicas. Every replica reads through its own cursor and
+         * entries are dropped once all cursors have passed them. Readers must be added before the first
+         * append they are supposed to see.
+         */
+        class ReplicationLog {
+        public:
+            using Entry = std::shared_ptr<const Mutation>;
+
+        private:
+            struct Reader {
+                uint64_t cursor;
+                bool stopped = false;
+            };
+
+            mutable std::mutex mutex;
+            std::condition_variable appended;
+            std::deque<Entry> entries;
+            uint64_t firstSequence = 1;
+            std::atomic<uint64_t> last{0};
+            std::vector<Reader> readers;
+
+            void trim() {
+                uint64_t applied = last.load(std::memory_order_relaxed);
+                for (const Reader &reader : readers)
+                    if (!reader.stopped)
+                        applied = std::min(applied, reader.cursor);
+                while (!entries.empty() && firstSequence <= applied) {
+                    entries.pop_front();
+                    ++firstSequence;
+                }
+            }
+
+        public:
+            /**
+             * @return sequence number given to the mutation
+             */
+            uint64_t append(Mutation mutation) {
+                std::lock_guard<std::mutex> lock(mutex);
+                mutation.sequence = last.load(std::memory_order_relaxed) + 1;
+                entries.push_back(std::make_shared<const Mutation>(std::move(mutation)));
+                last.store(entries.back()->sequence, std::memory_order_release);
+                appended.notify_all();
+                return entries.back()->sequence;
+            }
+
+            uint64_t lastSequence() const {
+                return last.load(std::memory_order_acquire);
+            }
+
+            size_t backlog() const {
+                std::lock_guard<std::mutex> lock(mutex);
+                return entries.size();
+            }
+
+            size_t addReader() {
+                std::lock_guard<std::mutex> lock(mutex);
+                readers.push_back(Reader{firstSequence - 1});
+                return readers.size() - 1;
+            }
+
+            void stopReader(const size_t reader) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    readers[reader].stopped = true;
+                    trim();
+                }
+                appended.notify_all();
+            }
+
+            /**
+             * Waits for mutations past the reader's cursor and takes up to maxBatch of them.
+             * @return false once the reader is stopped
+             */
+            bool read(const size_t reader, std::vector<Entry> &batch, const size_t maxBatch) {
+                batch.clear();
+                std::unique_lock<std::mutex> lock(mutex);
+                appended.wait(lock, [&] {
+                    return readers[reader].stopped || readers[reader].cursor < last.load(std::memory_order_relaxed);
+                });
+                if (readers[reader].stopped)
+                    return false;
+                const size_t begin = static_cast<size_t>(readers[reader].cursor + 1 - firstSequence);
+                const size_t end = std::min(entries.size(), begin + maxBatch);
+                batch.assign(entries.begin() + begin, entries.begin() + end);
+                return true;
+            }
+
+            /**
+             * Moves the reader's cursor past the mutations it has applied.
+             */
+            void acknowledge(const size_t reader, const uint64_t sequence) {
+                std::lock_guard<std::mutex> lock(mutex);
+                readers[reader].cursor = sequence;
+                trim();
+            }
+        };
+    }
+}
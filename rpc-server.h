@@ -0,0 +1,594 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "rpc.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Serves a Backend to other processes over a Unix domain socket.
+         *
+         * One thread runs an epoll loop over non-blocking connections: it reads whatever arrived, executes
+         * every complete request in order and queues the responses, so clients may pipeline requests freely.
+         * Password-bound calls (auth, registerUser) are handed to a few worker threads instead, keeping
+         * login storms from stalling everyone else; their responses, like pushed notifications, come back
+         * to the loop through an eventfd. Output is flushed with gathered sends, and downloadVideo content is
+         * queued as its own buffer behind a small header, so payloads are never copied into a frame. A client
+         * that does not read its responses is no longer read from once maxQueuedOutput bytes wait for it.
+         */
+        class RpcServer {
+        private:
+            using Chunks = std::vector<std::string>;
+
+            static constexpr uint64_t listenerKey = 0;
+            static constexpr uint64_t wakeKey = 1;
+            static constexpr size_t readSize = 64 * 1024;
+            static constexpr int maxBatchedBuffers = 64;
+            // output a connection may have queued before the server stops reading its requests
+            static constexpr size_t maxQueuedOutput = 4 * 1024 * 1024;
+
+            struct Connection {
+                const int fd;
+                std::string input;
+                std::deque<std::string> output;
+                size_t outputOffset = 0;
+                size_t outputBytes = 0;
+                uint32_t events = EPOLLIN;
+                // the client shut down its side; the connection closes once everything is answered
+                bool inputClosed = false;
+                // requests handed to the workers and not answered yet
+                size_t inFlight = 0;
+                std::vector<std::shared_ptr<ClientCallback>> callbacks;
+
+                explicit Connection(const int fd) : fd(fd) {}
+
+                ~Connection() {
+                    close(fd);
+                }
+            };
+
+            const std::shared_ptr<Backend> backend;
+            const std::string path;
+            int listenFd = -1;
+            int epollFd = -1;
+            int wakeFd = -1;
+            std::atomic<bool> stopped{false};
+            uint64_t nextConnectionKey = wakeKey + 1;
+            std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+
+            struct Posted {
+                uint64_t key;
+                Chunks chunks;
+                // answers a request counted in Connection::inFlight, as opposed to a notification
+                bool response;
+            };
+
+            std::mutex postedMutex;
+            std::vector<Posted> posted;
+
+            std::mutex tasksMutex;
+            std::condition_variable tasksCondition;
+            std::deque<std::function<void()>> tasks;
+            std::vector<std::thread> workers;
+
+            static void check(const bool success, const char *what) {
+                if (!success)
+                    throw std::runtime_error(std::string("Exception: rpc server: ") + what + " failed: " +
+                                             std::to_string(errno));
+            }
+
+            static Chunks failure(const uint32_t id, const rpc::Status status, const std::string &message) {
+                rpc::MessageWriter response(rpc::MessageType::Response, id);
+                response.writeU8(static_cast<uint8_t>(status));
+                response.writeString(message);
+                return {response.finish()};
+            }
+
+            static rpc::Status statusOf(const std::exception &exception) {
+                if (dynamic_cast<const NoSuchUserException *>(&exception))
+                    return rpc::Status::NoSuchUser;
+                if (dynamic_cast<const UserAlreadyExistsException *>(&exception))
+                    return rpc::Status::UserAlreadyExists;
+                if (dynamic_cast<const NoSuchVideoException *>(&exception))
+                    return rpc::Status::NoSuchVideo;
+                if (dynamic_cast<const NoSuchCommentException *>(&exception))
+                    return rpc::Status::NoSuchComment;
+                if (dynamic_cast<const NotAuthorizedException *>(&exception))
+                    return rpc::Status::NotAuthorized;
+                if (dynamic_cast<const WrongPasswordException *>(&exception))
+                    return rpc::Status::WrongPassword;
+                if (dynamic_cast<const ServiceOverloadedException *>(&exception))
+                    return rpc::Status::ServiceOverloaded;
+                return rpc::Status::Failed;
+            }
+
+            static bool isSlow(const rpc::MessageType type) {
+                return type == rpc::MessageType::Auth || type == rpc::MessageType::RegisterUser;
+            }
+
+            void wake() {
+                const uint64_t one = 1;
+                while (write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+            }
+
+            /**
+             * Queues output for a connection from any thread; dropped if the connection is gone by then.
+             */
+            void post(const uint64_t key, Chunks chunks, const bool response = false) {
+                {
+                    std::lock_guard<std::mutex> lock(postedMutex);
+                    posted.push_back(Posted{key, std::move(chunks), response});
+                }
+                wake();
+            }
+
+            std::shared_ptr<ClientCallback> makeCallback(const uint64_t key, const uint32_t subscription) {
+                return std::make_shared<ClientCallback>([this, key, subscription](
+                        const std::shared_ptr<Notification> notification) {
+                    rpc::MessageWriter message(rpc::MessageType::Notification, subscription);
+                    message.writeU64(notification->getUploads());
+                    message.writeVideo(notification->getObject());
+                    post(key, {message.finish()});
+                });
+            }
+
+            /**
+             * Runs one request against the backend. The connection is only passed on the loop thread
+             * and is needed by setClientCallback alone.
+             */
+            Chunks execute(Connection *connection, const uint64_t key, const rpc::MessageType type,
+                           const uint32_t id, rpc::MessageReader request) {
+                rpc::MessageWriter response(rpc::MessageType::Response, id);
+                try {
+                    switch (type) {
+                        case rpc::MessageType::Auth: {
+                            const std::string name = request.readString();
+                            const std::string password = request.readString();
+                            const std::string token = backend->auth(name, password);
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeString(token);
+                            return {response.finish()};
+                        }
+                        case rpc::MessageType::Logout:
+                            backend->logout(request.readString());
+                            break;
+                        case rpc::MessageType::RegisterUser: {
+                            const std::string name = request.readString();
+                            const std::string password = request.readString();
+                            backend->registerUser(name, password);
+                            break;
+                        }
+                        case rpc::MessageType::DownloadVideo: {
+                            const std::string id = request.readString();
+                            std::string content = backend->downloadVideo(request.readString(), id);
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeU32(static_cast<uint32_t>(content.size()));
+                            Chunks chunks;
+                            chunks.push_back(response.finish(content.size()));
+                            chunks.push_back(std::move(content));
+                            return chunks;
+                        }
+                        case rpc::MessageType::SearchVideos: {
+                            std::vector<std::string> words(request.readU32());
+                            for (std::string &word : words)
+                                word = request.readString();
+                            const std::vector<std::shared_ptr<Video>> videos =
+                                    backend->searchVideos(request.readString(), words);
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeU32(static_cast<uint32_t>(videos.size()));
+                            for (const std::shared_ptr<Video> &video : videos)
+                                response.writeVideo(video);
+                            return {response.finish()};
+                        }
+                        case rpc::MessageType::AddVideo: {
+                            const std::string token = request.readString();
+                            const std::string name = request.readString();
+                            const std::string content = request.readString();
+                            backend->addVideo(token, name, content);
+                            break;
+                        }
+                        case rpc::MessageType::GetVideo: {
+                            const std::string id = request.readString();
+                            const std::shared_ptr<Video> video = backend->getVideo(request.readString(), id);
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeVideo(video);
+                            return {response.finish()};
+                        }
+                        case rpc::MessageType::LeaveComment: {
+                            const std::string token = request.readString();
+                            const std::string videoId = request.readString();
+                            const std::string comment = request.readString();
+                            backend->leaveComment(token, videoId, comment);
+                            break;
+                        }
+                        case rpc::MessageType::LeaveReply: {
+                            const std::string token = request.readString();
+                            const std::string videoId = request.readString();
+                            const std::string comment = request.readString();
+                            backend->leaveComment(token, videoId, comment, request.readU64());
+                            break;
+                        }
+                        case rpc::MessageType::LeaveLike: {
+                            const std::string token = request.readString();
+                            backend->leaveLike(token, request.readString());
+                            break;
+                        }
+                        case rpc::MessageType::LikeComment: {
+                            const std::string token = request.readString();
+                            const std::string videoId = request.readString();
+                            backend->leaveLike(token, videoId, request.readU64());
+                            break;
+                        }
+                        case rpc::MessageType::SetClientCallback: {
+                            const std::shared_ptr<ClientCallback> callback = makeCallback(key, id);
+                            backend->setClientCallback(request.readString(), callback);
+                            // the backend only keeps a weak reference; the connection owns the callback
+                            connection->callbacks.push_back(callback);
+                            break;
+                        }
+                        case rpc::MessageType::SubscribeFor: {
+                            const std::string token = request.readString();
+                            backend->subscribeFor(token, request.readString());
+                            break;
+                        }
+                        case rpc::MessageType::UnsubscribeFrom: {
+                            const std::string token = request.readString();
+                            backend->unsubscribeFrom(token, request.readString());
+                            break;
+                        }
+                        case rpc::MessageType::ReleasePendingNotifications:
+                            backend->releasePendingNotifications(request.readString());
+                            break;
+                        case rpc::MessageType::GetTrending: {
+                            const uint8_t window = request.readU8();
+                            if (window > static_cast<uint8_t>(TrendingWindow::Day))
+                                throw rpc::ProtocolException("bad trending window");
+                            const std::vector<TrendingVideo> trending =
+                                    backend->getTrending(static_cast<TrendingWindow>(window), request.readU32());
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeU32(static_cast<uint32_t>(trending.size()));
+                            for (const TrendingVideo &entry : trending) {
+                                response.writeU64(entry.events);
+                                response.writeVideo(entry.video);
+                            }
+                            return {response.finish()};
+                        }
+                        case rpc::MessageType::Complete: {
+                            const std::string prefix = request.readString();
+                            const Completions completions = backend->complete(prefix, request.readU32());
+                            response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                            response.writeU32(static_cast<uint32_t>(completions.videos.size()));
+                            for (const std::shared_ptr<Video> &video : completions.videos)
+                                response.writeVideo(video);
+                            response.writeU32(static_cast<uint32_t>(completions.userNames.size()));
+                            for (const std::string &name : completions.userNames)
+                                response.writeString(name);
+                            return {response.finish()};
+                        }
+                        default:
+                            return failure(id, rpc::Status::Failed, "Exception: unknown request");
+                    }
+                } catch (const std::exception &exception) {
+                    return failure(id, statusOf(exception), exception.what());
+                }
+                response.writeU8(static_cast<uint8_t>(rpc::Status::Ok));
+                return {response.finish()};
+            }
+
+            void submit(std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(tasksMutex);
+                    tasks.push_back(std::move(task));
+                }
+                tasksCondition.notify_one();
+            }
+
+            void workerLoop() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(tasksMutex);
+                        tasksCondition.wait(lock, [this] { return stopped || !tasks.empty(); });
+                        if (tasks.empty())
+                            return;
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+            }
+
+            static void enqueue(Connection &connection, Chunks chunks) {
+                for (std::string &chunk : chunks) {
+                    // an empty buffer, such as the content of an empty video, would never be written off
+                    if (chunk.empty())
+                        continue;
+                    connection.outputBytes += chunk.size();
+                    connection.output.push_back(std::move(chunk));
+                }
+            }
+
+            void watch(const int fd, const uint64_t key, const uint32_t events, const int operation) {
+                epoll_event event{};
+                event.events = events;
+                event.data.u64 = key;
+                check(epoll_ctl(epollFd, operation, fd, &event) == 0, "epoll_ctl");
+            }
+
+            void acceptConnections() {
+                while (true) {
+                    const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        return;
+                    }
+                    const uint64_t key = nextConnectionKey++;
+                    connections.emplace(key, std::make_unique<Connection>(fd));
+                    watch(fd, key, EPOLLIN, EPOLL_CTL_ADD);
+                }
+            }
+
+            void closeConnection(const uint64_t key) {
+                const auto found = connections.find(key);
+                if (found == connections.end())
+                    return;
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, found->second->fd, nullptr);
+                connections.erase(found);
+            }
+
+            /**
+             * Reads and executes requests until the socket is drained or maxQueuedOutput bytes of responses
+             * wait; the rest stays in the socket until the client reads enough. Requests that arrived before
+             * the client shut down its side are still answered.
+             * @return false if the connection has to be closed
+             */
+            bool readRequests(const uint64_t key, Connection &connection) {
+                while (!connection.inputClosed && connection.outputBytes < maxQueuedOutput) {
+                    const size_t size = connection.input.size();
+                    connection.input.resize(size + readSize);
+                    const ssize_t received = recv(connection.fd, &connection.input[size], readSize, 0);
+                    connection.input.resize(size + std::max<ssize_t>(received, 0));
+                    if (received > 0) {
+                        if (!executeRequests(key, connection))
+                            return false;
+                        continue;
+                    }
+                    if (received == 0) {
+                        connection.inputClosed = true;
+                        break;
+                    }
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        break;
+                    return false;
+                }
+                return flush(key, connection);
+            }
+
+            /**
+             * Executes the complete requests buffered so far and queues their responses.
+             * @return false on a malformed frame
+             */
+            bool executeRequests(const uint64_t key, Connection &connection) {
+                size_t offset = 0;
+                rpc::MessageType type;
+                uint32_t id;
+                const char *payload;
+                size_t payloadSize;
+                try {
+                    while (rpc::nextFrame(connection.input, offset, type, id, payload, payloadSize)) {
+                        if (isSlow(type)) {
+                            ++connection.inFlight;
+                            submit([this, key, type, id, request = std::string(payload, payloadSize)] {
+                                post(key, execute(nullptr, key, type, id,
+                                                  rpc::MessageReader(request.data(), request.size())), true);
+                            });
+                            continue;
+                        }
+                        enqueue(connection, execute(&connection, key, type, id,
+                                                    rpc::MessageReader(payload, payloadSize)));
+                    }
+                } catch (const rpc::ProtocolException &) {
+                    return false;
+                }
+                connection.input.erase(0, offset);
+                return true;
+            }
+
+            /**
+             * Writes queued output until the socket is full, gathering up to maxBatchedBuffers buffers per call,
+             * and resumes reading requests once the output is below maxQueuedOutput again.
+             * @return false if the connection has to be closed, also once a half-closed one is fully answered
+             */
+            bool flush(const uint64_t key, Connection &connection) {
+                while (!connection.output.empty()) {
+                    iovec buffers[maxBatchedBuffers];
+                    int count = 0;
+                    size_t offset = connection.outputOffset;
+                    for (auto chunk = connection.output.begin();
+                         chunk != connection.output.end() && count < maxBatchedBuffers; ++chunk, offset = 0) {
+                        buffers[count].iov_base = &(*chunk)[offset];
+                        buffers[count].iov_len = chunk->size() - offset;
+                        ++count;
+                    }
+                    msghdr message{};
+                    message.msg_iov = buffers;
+                    message.msg_iovlen = count;
+                    // a peer that went away shows up as EPIPE rather than a SIGPIPE killing the server
+                    ssize_t written = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+                    if (written < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                            return false;
+                        break;
+                    }
+                    while (!connection.output.empty()) {
+                        const size_t left = connection.output.front().size() - connection.outputOffset;
+                        if (static_cast<size_t>(written) < left) {
+                            connection.outputOffset += written;
+                            break;
+                        }
+                        written -= left;
+                        connection.outputBytes -= connection.output.front().size();
+                        connection.output.pop_front();
+                        connection.outputOffset = 0;
+                    }
+                }
+
+                const bool pending = !connection.output.empty();
+                if (connection.inputClosed && !pending && connection.inFlight == 0)
+                    return false;
+                const bool reading = !connection.inputClosed && connection.outputBytes < maxQueuedOutput;
+                const uint32_t events = (reading ? uint32_t(EPOLLIN) : 0u) | (pending ? uint32_t(EPOLLOUT) : 0u);
+                if (events != connection.events) {
+                    connection.events = events;
+                    watch(connection.fd, key, events, EPOLL_CTL_MOD);
+                }
+                return true;
+            }
+
+            void deliverPosted() {
+                uint64_t counter;
+                while (read(wakeFd, &counter, sizeof(counter)) < 0 && errno == EINTR) {}
+
+                std::vector<Posted> batch;
+                {
+                    std::lock_guard<std::mutex> lock(postedMutex);
+                    batch.swap(posted);
+                }
+                std::vector<uint64_t> touched;
+                for (Posted &entry : batch) {
+                    const auto found = connections.find(entry.key);
+                    if (found == connections.end())
+                        continue;
+                    if (entry.response)
+                        --found->second->inFlight;
+                    enqueue(*found->second, std::move(entry.chunks));
+                    touched.push_back(entry.key);
+                }
+                for (const uint64_t key : touched) {
+                    const auto found = connections.find(key);
+                    if (found != connections.end() && !flush(key, *found->second))
+                        closeConnection(key);
+                }
+            }
+
+        public:
+            /**
+             * Binds the socket right away, replacing a stale socket file at the same path.
+             * @param workerCount threads executing auth and registerUser
+             */
+            RpcServer(std::shared_ptr<Backend> backend, std::string path, const size_t workerCount = 2)
+                    : backend(std::move(backend)), path(std::move(path)) {
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+                if (this->path.size() >= sizeof(address.sun_path))
+                    throw std::runtime_error("Exception: rpc server: socket path too long");
+                this->path.copy(address.sun_path, this->path.size());
+
+                listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                check(listenFd >= 0, "socket");
+                unlink(this->path.c_str());
+                check(bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0, "bind");
+                check(listen(listenFd, SOMAXCONN) == 0, "listen");
+
+                epollFd = epoll_create1(EPOLL_CLOEXEC);
+                check(epollFd >= 0, "epoll_create1");
+                wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                check(wakeFd >= 0, "eventfd");
+                watch(listenFd, listenerKey, EPOLLIN, EPOLL_CTL_ADD);
+                watch(wakeFd, wakeKey, EPOLLIN, EPOLL_CTL_ADD);
+
+                for (size_t i = 0; i < std::max<size_t>(1, workerCount); ++i)
+                    workers.emplace_back([this] { workerLoop(); });
+            }
+
+            RpcServer(const RpcServer &) = delete;
+
+            ~RpcServer() {
+                stop();
+                for (std::thread &worker : workers)
+                    worker.join();
+                connections.clear();
+                close(wakeFd);
+                close(epollFd);
+                close(listenFd);
+                unlink(path.c_str());
+            }
+
+            /**
+             * Serves connections on the calling thread until stop() is called.
+             */
+            void run() {
+                epoll_event events[64];
+                while (!stopped) {
+                    const int ready = epoll_wait(epollFd, events, 64, -1);
+                    if (ready < 0) {
+                        check(errno == EINTR, "epoll_wait");
+                        continue;
+                    }
+                    for (int i = 0; i < ready; ++i) {
+                        const uint64_t key = events[i].data.u64;
+                        if (key == listenerKey) {
+                            acceptConnections();
+                            continue;
+                        }
+                        if (key == wakeKey) {
+                            deliverPosted();
+                            continue;
+                        }
+                        const auto found = connections.find(key);
+                        if (found == connections.end())
+                            continue;
+                        Connection &connection = *found->second;
+                        // hang-up means the client closed both ways and can no longer take responses
+                        bool alive = !(events[i].events & (EPOLLHUP | EPOLLERR));
+                        if (alive && (events[i].events & EPOLLIN))
+                            alive = readRequests(key, connection);
+                        if (alive && (events[i].events & EPOLLOUT))
+                            alive = flush(key, connection);
+                        if (!alive)
+                            closeConnection(key);
+                    }
+                }
+            }
+
+            /**
+             * Makes run() return; safe to call from any thread.
+             */
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock(tasksMutex);
+                    stopped = true;
+                }
+                tasksCondition.notify_all();
+                wake();
+            }
+        };
+    }
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "common-data.h"
+
+namespace youtube {
+    namespace rpc {
+        /**
+         * Wire format shared by RpcServer and RemoteBackend.
+         *
+         * Every frame is a little-endian header [u32 length][u8 type][u32 id] followed by length - 5 payload
+         * bytes. Requests carry the Backend method as type and a caller-chosen id; responses echo the id,
+         * so a client may pipeline any number of requests and match answers in whatever order they come.
+         * Notifications are pushed with the id of the setClientCallback request they belong to.
+         * Reads end with the caller's auth token, possibly empty, for read-your-writes routing.
+         * Strings are [u32 size][bytes], integers are fixed-width little-endian.
+         */
+        enum class MessageType : uint8_t {
+            Auth = 1,
+            Logout,
+            RegisterUser,
+            DownloadVideo,
+            SearchVideos,
+            AddVideo,
+            GetVideo,
+            LeaveComment,
+            LeaveReply,
+            LeaveLike,
+            LikeComment,
+            SetClientCallback,
+            SubscribeFor,
+            UnsubscribeFrom,
+            ReleasePendingNotifications,
+            GetTrending,
+            Complete,
+            Response = 0x80,
+            Notification = 0x81
+        };
+
+        enum class Status : uint8_t {
+            Ok = 0,
+            NoSuchUser,
+            UserAlreadyExists,
+            NoSuchVideo,
+            NoSuchComment,
+            NotAuthorized,
+            WrongPassword,
+            ServiceOverloaded,
+            Failed
+        };
+
+        constexpr size_t headerSize = 9;
+        constexpr uint32_t maxFrameSize = 64u << 20;
+
+        class ProtocolException : public std::runtime_error {
+        public:
+            explicit ProtocolException(const std::string &message)
+                    : runtime_error("Exception: protocol error: " + message) {}
+        };
+
+        class MessageWriter {
+        private:
+            std::string buffer;
+
+        public:
+            MessageWriter(const MessageType type, const uint32_t id) {
+                buffer.resize(4);
+                writeU8(static_cast<uint8_t>(type));
+                writeU32(id);
+            }
+
+            void writeU8(const uint8_t value) {
+                buffer.push_back(static_cast<char>(value));
+            }
+
+            void writeU32(const uint32_t value) {
+                for (int i = 0; i < 4; ++i)
+                    buffer.push_back(static_cast<char>(value >> (8 * i)));
+            }
+
+            void writeU64(const uint64_t value) {
+                for (int i = 0; i < 8; ++i)
+                    buffer.push_back(static_cast<char>(value >> (8 * i)));
+            }
+
+            void writeString(const std::string &value) {
+                writeU32(static_cast<uint32_t>(value.size()));
+                buffer.append(value);
+            }
+
+            void writeComments(const CommentList &comments) {
+                writeU32(static_cast<uint32_t>(comments.size()));
+                for (const CommentList::Element &comment : comments) {
+                    writeString(comment->userName);
+                    writeString(comment->content);
+                    writeU64(comment->getLikes());
+                    writeComments(comment->getReplies());
+                }
+            }
+
+            void writeVideo(const std::shared_ptr<Video> &video) {
+                writeString(video->id);
+                writeString(video->title);
+                writeU64(video->getLikes());
+                video->visitComments([this](const CommentList &comments) {
+                    writeComments(comments);
+                });
+            }
+
+            /**
+             * @param trailingBytes size of a body that will be sent right after this buffer without copying
+             * @return the complete frame, or the frame prefix when trailingBytes is non-zero
+             */
+            std::string finish(const size_t trailingBytes = 0) {
+                const auto length = static_cast<uint32_t>(buffer.size() - 4 + trailingBytes);
+                for (int i = 0; i < 4; ++i)
+                    buffer[i] = static_cast<char>(length >> (8 * i));
+                return std::move(buffer);
+            }
+        };
+
+        class MessageReader {
+        private:
+            const char *data;
+            const size_t size;
+            size_t position = 0;
+
+            const char *take(const size_t count) {
+                if (size - position < count)
+                    throw ProtocolException("truncated message");
+                const char *result = data + position;
+                position += count;
+                return result;
+            }
+
+        public:
+            MessageReader(const char *data, const size_t size) : data(data), size(size) {}
+
+            uint8_t readU8() {
+                return static_cast<uint8_t>(*take(1));
+            }
+
+            uint32_t readU32() {
+                const auto *bytes = reinterpret_cast<const uint8_t *>(take(4));
+                uint32_t result = 0;
+                for (int i = 0; i < 4; ++i)
+                    result |= static_cast<uint32_t>(bytes[i]) << (8 * i);
+                return result;
+            }
+
+            uint64_t readU64() {
+                const auto *bytes = reinterpret_cast<const uint8_t *>(take(8));
+                uint64_t result = 0;
+                for (int i = 0; i < 8; ++i)
+                    result |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+                return result;
+            }
+
+            std::string readString() {
+                const uint32_t length = readU32();
+                return std::string(take(length), length);
+            }
+
+            CommentList readComments();
+
+            std::shared_ptr<Video> readVideo();
+        };
+
+        /**
+         * Read-only copies of backend objects received over the wire.
+         */
+        class RemoteVideo : public Video {
+        private:
+            const size_t likes;
+            const std::shared_ptr<const CommentList> comments;
+
+        public:
+            RemoteVideo(std::string id, std::string title, const size_t likes, CommentList comments)
+                    : Video(std::move(id), std::move(title)), likes(likes),
+                      comments(std::make_shared<CommentList>(std::move(comments))) {}
+
+            std::shared_ptr<const CommentList> getComments() const override {
+                return comments;
+            }
+
+            const size_t getLikes() const override {
+                return likes;
+            }
+        };
+
+        inline CommentList MessageReader::readComments() {
+            const uint32_t count = readU32();
+            std::vector<CommentList::Element> result;
+            result.reserve(std::min<uint32_t>(count, 1024));
+            for (uint32_t i = 0; i < count; ++i) {
+                std::string userName = readString();
+                std::string content = readString();
+                const uint64_t likes = readU64();
+                result.push_back(std::make_shared<Comment>(std::move(userName), std::move(content),
+                                                           static_cast<size_t>(likes), readComments()));
+            }
+            return CommentList(std::move(result));
+        }
+
+        inline std::shared_ptr<Video> MessageReader::readVideo() {
+            std::string id = readString();
+            std::string title = readString();
+            const uint64_t likes = readU64();
+            return std::make_shared<RemoteVideo>(std::move(id), std::move(title), static_cast<size_t>(likes),
+                                                 readComments());
+        }
+
+        /**
+         * Splits complete frames off the front of a receive buffer.
+         * @return false if the buffer does not hold a whole frame yet
+         */
+        inline bool nextFrame(const std::string &buffer, size_t &offset, MessageType &type, uint32_t &id,
+                              const char *&payload, size_t &payloadSize) {
+            if (buffer.size() - offset < headerSize)
+                return false;
+            MessageReader header(buffer.data() + offset, headerSize);
+            const uint32_t length = header.readU32();
+            if (length < headerSize - 4 || length > maxFrameSize)
+                throw ProtocolException("bad frame length");
+            if (buffer.size() - offset < 4 + static_cast<size_t>(length))
+                return false;
+            type = static_cast<MessageType>(header.readU8());
+            id = header.readU32();
+            payload = buffer.data() + offset + headerSize;
+            payloadSize = length - (headerSize - 4);
+            offset += 4 + length;
+            return true;
+        }
+    }
+}
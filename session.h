@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Bounded table of authorized sessions.
+         *
+         * Validation is a lock-free linear probe over a fixed open-addressing table whose slots are
+         * published with a per-slot sequence lock. Opening, closing and expiring sessions are serialized
+         * by a single writer mutex. Expiry is driven by a hashed timer wheel, and when the table is full
+         * the session closest to expiry is evicted, so memory never grows past the configured capacity.
+         */
+        class SessionManager {
+        public:
+            using Clock = std::chrono::steady_clock;
+            using ExpiryListener = std::function<void(const TokenKey &token, uint32_t userId)>;
+
+            static constexpr std::chrono::milliseconds defaultTimeToLive = std::chrono::minutes(30);
+            static constexpr size_t defaultCapacity = 1 << 18;
+
+        private:
+            enum SlotState : uint32_t {
+                Empty = 0,
+                Live = 1,
+                Deleted = 2
+            };
+
+            struct Slot {
+                std::atomic<uint32_t> version{0};
+                std::atomic<uint32_t> state{Empty};
+                std::atomic<uint64_t> high{0};
+                std::atomic<uint64_t> low{0};
+                std::atomic<uint32_t> userId{0};
+                std::atomic<int64_t> expiresAt{0};
+            };
+
+            struct WheelEntry {
+                TokenKey token;
+                int64_t expiresAt;
+            };
+
+            static constexpr size_t wheelSize = 256;
+
+            const int64_t timeToLive;
+            const int64_t tickLength;
+            const size_t mask;
+            const size_t maxSessions;
+            const std::unique_ptr<Slot[]> slots;
+
+            std::mutex writeMutex;
+            size_t liveSessions = 0;
+            std::vector<std::vector<WheelEntry>> wheel;
+            int64_t processedTick;
+            std::vector<ExpiryListener> listeners;
+
+            static int64_t now() {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                        Clock::now().time_since_epoch()).count();
+            }
+
+            size_t home(const TokenKey &token) const {
+                return TokenKeyHash()(token) & mask;
+            }
+
+            std::vector<WheelEntry> &bucketFor(const int64_t expiresAt) {
+                return wheel[static_cast<size_t>(expiresAt / tickLength) % wheelSize];
+            }
+
+            static void beginWrite(Slot &slot) {
+                slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            static void endWrite(Slot &slot) {
+                slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            size_t findLive(const TokenKey &token) const {
+                size_t index = home(token);
+                for (size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+                    const Slot &slot = slots[index];
+                    const uint32_t state = slot.state.load(std::memory_order_relaxed);
+                    if (state == Empty)
+                        break;
+                    if (state == Live && slot.high.load(std::memory_order_relaxed) == token.high
+                        && slot.low.load(std::memory_order_relaxed) == token.low)
+                        return index;
+                }
+                return npos;
+            }
+
+            void erase(const size_t index) {
+                Slot &slot = slots[index];
+                const TokenKey token{slot.high.load(std::memory_order_relaxed),
+                                     slot.low.load(std::memory_order_relaxed)};
+                const uint32_t userId = slot.userId.load(std::memory_order_relaxed);
+
+                beginWrite(slot);
+                slot.state.store(Deleted, std::memory_order_relaxed);
+                endWrite(slot);
+                --liveSessions;
+
+                // a tombstone directly before an empty slot ends every probe chain through it anyway
+                size_t tail = index;
+                while (slots[(tail + 1) & mask].state.load(std::memory_order_relaxed) == Empty
+                       && slots[tail].state.load(std::memory_order_relaxed) == Deleted) {
+                    beginWrite(slots[tail]);
+                    slots[tail].state.store(Empty, std::memory_order_relaxed);
+                    endWrite(slots[tail]);
+                    tail = (tail - 1) & mask;
+                }
+
+                for (const ExpiryListener &listener : listeners)
+                    listener(token, userId);
+            }
+
+            void unschedule(const TokenKey &token, const int64_t expiresAt) {
+                std::vector<WheelEntry> &bucket = bucketFor(expiresAt);
+                for (size_t i = 0; i < bucket.size(); ++i) {
+                    if (bucket[i].token == token) {
+                        bucket[i] = bucket.back();
+                        bucket.pop_back();
+                        return;
+                    }
+                }
+            }
+
+            void expireUntil(const int64_t time) {
+                const int64_t lastTick = time / tickLength;
+                if (lastTick - processedTick > static_cast<int64_t>(wheelSize))
+                    processedTick = lastTick - static_cast<int64_t>(wheelSize);
+                for (; processedTick <= lastTick; ++processedTick) {
+                    std::vector<WheelEntry> &bucket = wheel[static_cast<size_t>(processedTick) % wheelSize];
+                    for (size_t i = 0; i < bucket.size();) {
+                        if (bucket[i].expiresAt > time) {
+                            ++i;
+                            continue;
+                        }
+                        const size_t index = findLive(bucket[i].token);
+                        bucket[i] = bucket.back();
+                        bucket.pop_back();
+                        if (index != npos)
+                            erase(index);
+                    }
+                }
+                --processedTick;
+            }
+
+            void evictEarliest() {
+                for (size_t offset = 0; offset < wheelSize; ++offset) {
+                    std::vector<WheelEntry> &bucket = wheel[static_cast<size_t>(processedTick + offset) % wheelSize];
+                    if (bucket.empty())
+                        continue;
+                    size_t earliest = 0;
+                    for (size_t i = 1; i < bucket.size(); ++i)
+                        if (bucket[i].expiresAt < bucket[earliest].expiresAt)
+                            earliest = i;
+                    const size_t index = findLive(bucket[earliest].token);
+                    bucket[earliest] = bucket.back();
+                    bucket.pop_back();
+                    if (index != npos)
+                        erase(index);
+                    return;
+                }
+            }
+
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            /**
+             * @param capacity number of table slots, rounded up to a power of two; at most half are live
+             */
+            explicit SessionManager(const std::chrono::milliseconds timeToLive = defaultTimeToLive,
+                                    const size_t capacity = defaultCapacity)
+                    : timeToLive(timeToLive.count()),
+                      tickLength(std::max<int64_t>(1, timeToLive.count() / (wheelSize - 1) + 1)),
+                      mask(roundUpToPowerOfTwo(std::max<size_t>(capacity, 2)) - 1),
+                      maxSessions((mask + 1) / 2),
+                      slots(new Slot[mask + 1]),
+                      wheel(wheelSize),
+                      processedTick(now() / tickLength) {}
+
+            SessionManager(const SessionManager &) = delete;
+
+            SessionManager(SessionManager &&) = delete;
+
+            static SessionManager &instance() {
+                static SessionManager manager;
+                return manager;
+            }
+
+            static size_t roundUpToPowerOfTwo(size_t value) {
+                size_t result = 1;
+                while (result < value)
+                    result <<= 1;
+                return result;
+            }
+
+            /**
+             * Registers a listener invoked (under the writer lock) whenever a session expires or is closed.
+             */
+            void addExpiryListener(ExpiryListener listener) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                listeners.push_back(std::move(listener));
+            }
+
+            const TokenKey open(const uint32_t userId) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                const int64_t time = now();
+                expireUntil(time);
+                if (liveSessions >= maxSessions)
+                    evictEarliest();
+
+                TokenKey token;
+                do {
+                    token = SecureRandomGenerator::instance().nextToken();
+                } while (findLive(token) != npos);
+
+                size_t index = home(token);
+                while (slots[index].state.load(std::memory_order_relaxed) == Live)
+                    index = (index + 1) & mask;
+
+                const int64_t expiresAt = time + timeToLive;
+                Slot &slot = slots[index];
+                beginWrite(slot);
+                slot.high.store(token.high, std::memory_order_relaxed);
+                slot.low.store(token.low, std::memory_order_relaxed);
+                slot.userId.store(userId, std::memory_order_relaxed);
+                slot.expiresAt.store(expiresAt, std::memory_order_relaxed);
+                slot.state.store(Live, std::memory_order_relaxed);
+                endWrite(slot);
+                ++liveSessions;
+
+                bucketFor(expiresAt).push_back(WheelEntry{token, expiresAt});
+                return token;
+            }
+
+            /**
+             * Lock-free lookup of a live, non-expired session. Running into an expired one also collects
+             * the expired sessions, unless a writer holds the lock right now.
+             */
+            bool validate(const TokenKey &token, uint32_t &userId) {
+                const int64_t time = now();
+                size_t index = home(token);
+                for (size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+                    const Slot &slot = slots[index];
+                    uint32_t state, id;
+                    uint64_t high, low;
+                    int64_t expiresAt;
+                    while (true) {
+                        const uint32_t version = slot.version.load(std::memory_order_acquire);
+                        if (version & 1)
+                            continue;
+                        state = slot.state.load(std::memory_order_relaxed);
+                        high = slot.high.load(std::memory_order_relaxed);
+                        low = slot.low.load(std::memory_order_relaxed);
+                        id = slot.userId.load(std::memory_order_relaxed);
+                        expiresAt = slot.expiresAt.load(std::memory_order_relaxed);
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (slot.version.load(std::memory_order_relaxed) == version)
+                            break;
+                    }
+                    if (state == Empty)
+                        return false;
+                    if (state == Live && high == token.high && low == token.low) {
+                        if (expiresAt <= time) {
+                            std::unique_lock<std::mutex> lock(writeMutex, std::try_to_lock);
+                            if (lock.owns_lock())
+                                expireUntil(time);
+                            return false;
+                        }
+                        userId = id;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool close(const TokenKey &token) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                const size_t index = findLive(token);
+                if (index == npos)
+                    return false;
+                unschedule(token, slots[index].expiresAt.load(std::memory_order_relaxed));
+                erase(index);
+                expireUntil(now());
+                return true;
+            }
+
+            /**
+             * Drops every session whose time to live has elapsed.
+             */
+            void collectExpired() {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                expireUntil(now());
+            }
+
+            size_t size() {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                return liveSessions;
+            }
+
+            size_t capacity() const {
+                return maxSessions;
+            }
+        };
+
+        /**
+         * Background thread collecting expired sessions at a fixed interval, so that their listeners
+         * run close to the expiry even when nobody opens or closes a session.
+         */
+        class SessionReaper {
+        private:
+            SessionManager &sessions;
+            const std::chrono::milliseconds interval;
+            std::mutex mutex;
+            std::condition_variable stopCondition;
+            bool stopped = false;
+            std::thread thread;
+
+        public:
+            explicit SessionReaper(const std::chrono::milliseconds interval = std::chrono::seconds(1),
+                                   SessionManager &sessions = SessionManager::instance())
+                    : sessions(sessions), interval(interval) {
+                thread = std::thread([this] {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!stopCondition.wait_for(lock, this->interval, [this] { return stopped; }))
+                        this->sessions.collectExpired();
+                });
+            }
+
+            SessionReaper(const SessionReaper &) = delete;
+
+            ~SessionReaper() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopped = true;
+                }
+                stopCondition.notify_all();
+                thread.join();
+            }
+        };
+    }
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Directed adjacency lists over dense integer node IDs.
+         *
+         * Most edges live in a compressed sparse row (CSR) array: one offset per node and all neighbour
+         * lists stored back to back, sorted. Recent changes go to a small per-node delta (sorted inserted
+         * and erased lists) which is merged into the CSR arrays once it grows past a fraction of the graph,
+         * keeping updates amortized cheap and iteration mostly sequential.
+         */
+        class AdjacencyStore {
+        private:
+            static constexpr size_t minCompactionDelta = 4096;
+            static constexpr size_t compactionDivisor = 8;
+
+            std::vector<uint64_t> offsets{0};
+            std::vector<uint32_t> targets;
+            std::unordered_map<uint32_t, std::vector<uint32_t>> inserted;
+            std::unordered_map<uint32_t, std::vector<uint32_t>> erased;
+            size_t deltaSize = 0;
+            size_t edgeCount = 0;
+
+            static bool sortedContains(const std::vector<uint32_t> &list, const uint32_t value) {
+                return std::binary_search(list.begin(), list.end(), value);
+            }
+
+            static void sortedInsert(std::vector<uint32_t> &list, const uint32_t value) {
+                list.insert(std::lower_bound(list.begin(), list.end(), value), value);
+            }
+
+            static bool sortedErase(std::vector<uint32_t> &list, const uint32_t value) {
+                const auto it = std::lower_bound(list.begin(), list.end(), value);
+                if (it == list.end() || *it != value)
+                    return false;
+                list.erase(it);
+                return true;
+            }
+
+            bool inBase(const uint32_t from, const uint32_t to) const {
+                if (from + 1 >= offsets.size())
+                    return false;
+                return std::binary_search(targets.begin() + offsets[from], targets.begin() + offsets[from + 1], to);
+            }
+
+            const std::vector<uint32_t> *deltaList(const std::unordered_map<uint32_t, std::vector<uint32_t>> &delta,
+                                                   const uint32_t from) const {
+                const auto found = delta.find(from);
+                return found == delta.end() ? nullptr : &found->second;
+            }
+
+            void maybeCompact() {
+                if (deltaSize > std::max(minCompactionDelta, edgeCount / compactionDivisor))
+                    compact();
+            }
+
+        public:
+            bool contains(const uint32_t from, const uint32_t to) const {
+                if (inBase(from, to)) {
+                    const std::vector<uint32_t> *removed = deltaList(erased, from);
+                    return !removed || !sortedContains(*removed, to);
+                }
+                const std::vector<uint32_t> *added = deltaList(inserted, from);
+                return added && sortedContains(*added, to);
+            }
+
+            bool insert(const uint32_t from, const uint32_t to) {
+                if (contains(from, to))
+                    return false;
+                if (inBase(from, to)) {
+                    std::vector<uint32_t> &removed = erased[from];
+                    sortedErase(removed, to);
+                    if (removed.empty())
+                        erased.erase(from);
+                    --deltaSize;
+                } else {
+                    sortedInsert(inserted[from], to);
+                    ++deltaSize;
+                }
+                ++edgeCount;
+                maybeCompact();
+                return true;
+            }
+
+            bool erase(const uint32_t from, const uint32_t to) {
+                if (!contains(from, to))
+                    return false;
+                if (inBase(from, to)) {
+                    sortedInsert(erased[from], to);
+                    ++deltaSize;
+                } else {
+                    std::vector<uint32_t> &added = inserted[from];
+                    sortedErase(added, to);
+                    if (added.empty())
+                        inserted.erase(from);
+                    --deltaSize;
+                }
+                --edgeCount;
+                maybeCompact();
+                return true;
+            }
+
+            size_t degree(const uint32_t from) const {
+                size_t result = 0;
+                if (from + 1 < offsets.size())
+                    result = offsets[from + 1] - offsets[from];
+                if (const std::vector<uint32_t> *removed = deltaList(erased, from))
+                    result -= removed->size();
+                if (const std::vector<uint32_t> *added = deltaList(inserted, from))
+                    result += added->size();
+                return result;
+            }
+
+            /**
+             * Calls f(to) for every edge from the node: the CSR slice first, then recent inserts.
+             */
+            template<class F>
+            void forEach(const uint32_t from, F &&f) const {
+                if (from + 1 < offsets.size()) {
+                    const uint32_t *it = targets.data() + offsets[from];
+                    const uint32_t *end = targets.data() + offsets[from + 1];
+                    if (const std::vector<uint32_t> *removed = deltaList(erased, from)) {
+                        auto skip = removed->begin();
+                        for (; it != end; ++it) {
+                            while (skip != removed->end() && *skip < *it)
+                                ++skip;
+                            if (skip == removed->end() || *skip != *it)
+                                f(*it);
+                        }
+                    } else {
+                        for (; it != end; ++it)
+                            f(*it);
+                    }
+                }
+                if (const std::vector<uint32_t> *added = deltaList(inserted, from))
+                    for (const uint32_t to : *added)
+                        f(to);
+            }
+
+            /**
+             * Folds the delta into freshly built CSR arrays.
+             */
+            void compact() {
+                size_t nodes = offsets.size() - 1;
+                for (const auto &entry : inserted)
+                    nodes = std::max<size_t>(nodes, entry.first + 1);
+
+                std::vector<uint64_t> newOffsets(nodes + 1, 0);
+                std::vector<uint32_t> newTargets;
+                newTargets.reserve(edgeCount);
+                std::vector<uint32_t> merged;
+                for (uint32_t from = 0; from < nodes; ++from) {
+                    newOffsets[from] = newTargets.size();
+                    const std::vector<uint32_t> *added = deltaList(inserted, from);
+                    if (!added && !deltaList(erased, from) && from + 1 < offsets.size()) {
+                        newTargets.insert(newTargets.end(), targets.begin() + offsets[from],
+                                          targets.begin() + offsets[from + 1]);
+                        continue;
+                    }
+                    merged.clear();
+                    if (from + 1 < offsets.size()) {
+                        const std::vector<uint32_t> *removed = deltaList(erased, from);
+                        for (uint64_t i = offsets[from]; i < offsets[from + 1]; ++i)
+                            if (!removed || !sortedContains(*removed, targets[i]))
+                                merged.push_back(targets[i]);
+                    }
+                    if (added) {
+                        const size_t middle = merged.size();
+                        merged.insert(merged.end(), added->begin(), added->end());
+                        std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end());
+                    }
+                    newTargets.insert(newTargets.end(), merged.begin(), merged.end());
+                }
+                newOffsets[nodes] = newTargets.size();
+
+                offsets.swap(newOffsets);
+                targets.swap(newTargets);
+                inserted.clear();
+                erased.clear();
+                deltaSize = 0;
+            }
+
+            size_t size() const {
+                return edgeCount;
+            }
+
+            size_t memoryUsage() const {
+                size_t result = offsets.capacity() * sizeof(uint64_t) + targets.capacity() * sizeof(uint32_t);
+                for (const auto *delta : {&inserted, &erased}) {
+                    result += delta->bucket_count() * sizeof(void *);
+                    for (const auto &entry : *delta)
+                        result += sizeof(entry) + 2 * sizeof(void *) + entry.second.capacity() * sizeof(uint32_t);
+                }
+                return result;
+            }
+        };
+
+        /**
+         * Follower/subscription edges between users, keyed by User::id and stored in both directions:
+         * followers for notification fan-out and subscriptions for per-user lookups.
+         */
+        class SocialGraph {
+        private:
+            AdjacencyStore followers;
+            AdjacencyStore subscriptions;
+
+        public:
+            bool subscribe(const uint32_t follower, const uint32_t creator) {
+                if (!subscriptions.insert(follower, creator))
+                    return false;
+                followers.insert(creator, follower);
+                return true;
+            }
+
+            bool unsubscribe(const uint32_t follower, const uint32_t creator) {
+                if (!subscriptions.erase(follower, creator))
+                    return false;
+                followers.erase(creator, follower);
+                return true;
+            }
+
+            bool isSubscribed(const uint32_t follower, const uint32_t creator) const {
+                return subscriptions.contains(follower, creator);
+            }
+
+            size_t followerCount(const uint32_t creator) const {
+                return followers.degree(creator);
+            }
+
+            template<class F>
+            void forEachFollower(const uint32_t creator, F &&f) const {
+                followers.forEach(creator, std::forward<F>(f));
+            }
+
+            template<class F>
+            void forEachSubscription(const uint32_t follower, F &&f) const {
+                subscriptions.forEach(follower, std::forward<F>(f));
+            }
+
+            size_t size() const {
+                return subscriptions.size();
+            }
+
+            size_t memoryUsage() const {
+                return followers.memoryUsage() + subscriptions.memoryUsage();
+            }
+        };
+    }
+}
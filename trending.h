@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common-data.h"
+
+namespace youtube {
+    namespace backend {
+        /**
+         * Count-min sketch over a sliding time window: a ring of per-bucket sketches plus their running
+         * sum. Adding touches one counter per row in the current bucket and in the sum; when a bucket
+         * falls out of the window it is subtracted from the sum once and reused.
+         */
+        class WindowedSketch {
+        private:
+            static constexpr size_t depth = 4;
+            static constexpr size_t width = 1024;
+            static constexpr size_t cellsPerBucket = depth * width;
+
+            const uint64_t bucketSeconds;
+            const size_t bucketCount;
+            std::vector<uint32_t> buckets;
+            std::vector<uint32_t> sum;
+            uint64_t currentBucket = 0;
+
+            static size_t cell(const uint64_t key, const size_t row) {
+                uint64_t hash = key + 0x9e3779b97f4a7c15ULL * (row + 1);
+                hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+                hash ^= hash >> 31;
+                return row * width + (hash & (width - 1));
+            }
+
+        public:
+            WindowedSketch(const uint64_t bucketSeconds, const size_t bucketCount)
+                    : bucketSeconds(bucketSeconds), bucketCount(bucketCount),
+                      buckets(bucketCount * cellsPerBucket, 0), sum(cellsPerBucket, 0) {}
+
+            /**
+             * Expires buckets that have left the window ending at `now`.
+             * @return whether any bucket was expired
+             */
+            bool advance(const uint64_t nowSeconds) {
+                const uint64_t target = nowSeconds / bucketSeconds;
+                if (target <= currentBucket)
+                    return false;
+                const uint64_t steps = std::min<uint64_t>(target - currentBucket, bucketCount);
+                for (uint64_t step = 1; step <= steps; ++step) {
+                    uint32_t *bucket = &buckets[((currentBucket + step) % bucketCount) * cellsPerBucket];
+                    for (size_t i = 0; i < cellsPerBucket; ++i) {
+                        sum[i] -= bucket[i];
+                        bucket[i] = 0;
+                    }
+                }
+                currentBucket = target;
+                return true;
+            }
+
+            /**
+             * @return estimated count of the key in the window, including this addition
+             */
+            uint32_t add(const uint64_t key, const uint32_t weight) {
+                uint32_t *bucket = &buckets[(currentBucket % bucketCount) * cellsPerBucket];
+                uint32_t result = UINT32_MAX;
+                for (size_t row = 0; row < depth; ++row) {
+                    const size_t index = cell(key, row);
+                    bucket[index] += weight;
+                    result = std::min(result, sum[index] += weight);
+                }
+                return result;
+            }
+
+            uint32_t estimate(const uint64_t key) const {
+                uint32_t result = UINT32_MAX;
+                for (size_t row = 0; row < depth; ++row)
+                    result = std::min(result, sum[cell(key, row)]);
+                return result;
+            }
+
+            size_t memoryUsage() const {
+                return (buckets.size() + sum.size()) * sizeof(uint32_t);
+            }
+        };
+
+        /**
+         * Popularity of videos over the last minute, hour and day, fed with uploads and new likes.
+         *
+         * Every window counts events in a WindowedSketch and keeps a bounded set of candidates ordered
+         * by estimated count: an event updates the sketch and, if its video is a candidate or beats the
+         * weakest one, the candidate set. Both are bounded, so an event costs O(1) whatever the number
+         * of videos. Candidate counts are refreshed whenever a bucket expires.
+         */
+        class TrendingIndex {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr size_t candidateCapacity = 128;
+
+            struct Entry {
+                uint64_t key;
+                uint32_t events;
+            };
+
+        private:
+            struct Window {
+                WindowedSketch sketch;
+                std::unordered_map<uint64_t, uint32_t> candidates;
+                std::set<std::pair<uint32_t, uint64_t>> byEvents;
+
+                Window(const uint64_t bucketSeconds, const size_t bucketCount)
+                        : sketch(bucketSeconds, bucketCount) {}
+
+                void refresh() {
+                    byEvents.clear();
+                    for (auto it = candidates.begin(); it != candidates.end();) {
+                        it->second = sketch.estimate(it->first);
+                        if (it->second == 0) {
+                            it = candidates.erase(it);
+                        } else {
+                            byEvents.emplace(it->second, it->first);
+                            ++it;
+                        }
+                    }
+                }
+
+                void advance(const uint64_t nowSeconds) {
+                    if (sketch.advance(nowSeconds))
+                        refresh();
+                }
+
+                void add(const uint64_t key, const uint32_t weight) {
+                    const uint32_t events = sketch.add(key, weight);
+                    const auto found = candidates.find(key);
+                    if (found != candidates.end()) {
+                        byEvents.erase({found->second, key});
+                        found->second = events;
+                    } else if (candidates.size() < candidateCapacity) {
+                        candidates.emplace(key, events);
+                    } else if (events > byEvents.begin()->first) {
+                        candidates.erase(byEvents.begin()->second);
+                        byEvents.erase(byEvents.begin());
+                        candidates.emplace(key, events);
+                    } else {
+                        return;
+                    }
+                    byEvents.emplace(events, key);
+                }
+            };
+
+            std::array<Window, 3> windows{{{1, 60}, {60, 60}, {3600, 24}}};
+            const Clock::time_point epoch = Clock::now();
+            mutable std::mutex mutex;
+
+            uint64_t nowSeconds() const {
+                return static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - epoch).count());
+            }
+
+        public:
+            void record(const uint64_t key, const uint32_t weight = 1) {
+                const uint64_t now = nowSeconds();
+                std::lock_guard<std::mutex> lock(mutex);
+                for (Window &window : windows) {
+                    window.advance(now);
+                    window.add(key, weight);
+                }
+            }
+
+            /**
+             * @return up to `count` (at most candidateCapacity) most frequent keys, most frequent first
+             */
+            std::vector<Entry> top(const TrendingWindow span, const size_t count) {
+                const uint64_t now = nowSeconds();
+                std::lock_guard<std::mutex> lock(mutex);
+                Window &window = windows[static_cast<size_t>(span)];
+                window.advance(now);
+                std::vector<Entry> result;
+                for (auto it = window.byEvents.rbegin(); it != window.byEvents.rend() && result.size() < count; ++it)
+                    result.push_back(Entry{it->second, it->first});
+                return result;
+            }
+
+            size_t memoryUsage() const {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t result = 0;
+                for (const Window &window : windows)
+                    result += window.sketch.memoryUsage() +
+                              window.candidates.size() * (sizeof(uint64_t) + sizeof(uint32_t)) * 3;
+                return result;
+            }
+        };
+    }
+}
@@ -1,23 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
 #include <random>
+#include <string>
+#include <string_view>
 
+/**
+ * Fast non-cryptographic generator (xoshiro256**), one instance per thread.
+ * Used for identifiers which only need to be unique, not unpredictable.
+ */
 class RandomSequenceGenerator {
 private:
-    RandomSequenceGenerator() = default;
+    std::array<uint64_t, 4> state{};
+
+    RandomSequenceGenerator() {
+        std::random_device device;
+        uint64_t seed = (static_cast<uint64_t>(device()) << 32) | device();
+        for (uint64_t &word : state) {
+            // splitmix64 expansion of the seed
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
 
-    std::uniform_int_distribution<> distribution{'a', 'z'};
-    std::mt19937 gen{std::random_device{}()};
+    static uint64_t rotl(const uint64_t x, const int k) {
+        return (x << k) | (x >> (64 - k));
+    }
 
 public:
     static RandomSequenceGenerator &instance() {
-        static RandomSequenceGenerator generator;
+        static thread_local RandomSequenceGenerator generator;
+        return generator;
+    }
+
+    uint64_t nextUInt64() {
+        const uint64_t result = rotl(state[1] * 5, 7) * 9;
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+};
+
+/**
+ * 128-bit value used as an authorization token key.
+ */
+struct TokenKey {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const TokenKey &other) const {
+        return high == other.high && low == other.low;
+    }
+
+    bool operator!=(const TokenKey &other) const {
+        return !(*this == other);
+    }
+};
+
+struct TokenKeyHash {
+    size_t operator()(const TokenKey &key) const {
+        // token bits are already uniformly random
+        return static_cast<size_t>(key.low ^ (key.high * 0x9e3779b97f4a7c15ULL));
+    }
+};
+
+/**
+ * Generator of unpredictable values backed by the OS entropy source, one instance per thread.
+ */
+class SecureRandomGenerator {
+private:
+    std::random_device device;
+
+    SecureRandomGenerator() = default;
+
+public:
+    static SecureRandomGenerator &instance() {
+        static thread_local SecureRandomGenerator generator;
         return generator;
     }
 
-    const std::string nextRandomString(const size_t length) {
-        std::string result(length, '\u0000');
-        for (size_t i = 0; i < length; ++i) {
-            result[i] = static_cast<char>(distribution(gen));
+    uint64_t nextUInt64() {
+        const uint64_t high = device();
+        return (high << 32) | device();
+    }
+
+    TokenKey nextToken() {
+        TokenKey token;
+        token.high = nextUInt64();
+        token.low = nextUInt64();
+        return token;
+    }
+};
+
+/**
+ * Bijective fixed-width base64url encoding of integer identifiers:
+ * 11 characters per 64 bits, 22 characters per token.
+ */
+class IdCodec {
+private:
+    static constexpr const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    static int digit(const char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '-') return 62;
+        if (c == '_') return 63;
+        return -1;
+    }
+
+    static void encodeTo(uint64_t value, char *out) {
+        for (int i = idLength - 1; i >= 0; --i) {
+            out[i] = alphabet[value & 63];
+            value >>= 6;
+        }
+    }
+
+    static bool decodeFrom(const char *in, uint64_t &value) {
+        // the leading character carries only the 4 most significant bits
+        uint64_t result = 0;
+        for (size_t i = 0; i < idLength; ++i) {
+            const int d = digit(in[i]);
+            if (d < 0 || (i == 0 && d >= 16))
+                return false;
+            result = (result << 6) | static_cast<uint64_t>(d);
         }
+        value = result;
+        return true;
+    }
+
+public:
+    static constexpr size_t idLength = 11;
+    static constexpr size_t tokenLength = 2 * idLength;
+
+    static std::string encode(const uint64_t value) {
+        std::string result(idLength, 'A');
+        encodeTo(value, &result[0]);
         return result;
     }
-};
\ No newline at end of file
+
+    static std::string encode(const TokenKey &token) {
+        std::string result(tokenLength, 'A');
+        encodeTo(token.high, &result[0]);
+        encodeTo(token.low, &result[idLength]);
+        return result;
+    }
+
+    static bool decode(const std::string_view text, uint64_t &value) {
+        return text.size() == idLength && decodeFrom(text.data(), value);
+    }
+
+    static bool decode(const std::string_view text, TokenKey &token) {
+        return text.size() == tokenLength
+               && decodeFrom(text.data(), token.high)
+               && decodeFrom(text.data() + idLength, token.low);
+    }
+};